@@ -0,0 +1,394 @@
+/*
+ * batch.c
+ *
+ *   Simulador por lotes para el host: ejecuta miles de partidas sin
+ *   cabeza (sin matriz LED ni espera entre ticks) repartidas entre
+ *   varios hilos y resume el rendimiento y los resultados.
+ *
+ *   Reutiliza el motor de snake.c tal cual (se incluye con SNAKE_NO_MAIN)
+ *   y avanza cada partida con steerSnakes + stepWorld, de modo que lo que
+ *   se mide es exactamente el bucle interior del juego, con K serpientes
+ *   y M manzanas por partida.
+ *
+ *   Reparto del trabajo: las partidas se agrupan en lotes de BATCH_CHUNK;
+ *   cada hilo recibe un rango contiguo de lotes y los consume desde el
+ *   principio. Cuando se queda sin trabajo roba lotes del final del rango
+ *   de otro hilo. Cada rango es una sola palabra atómica (inicio y fin
+ *   empaquetados), así que tomar y robar son un compare-and-swap.
+ *
+ *   Los resultados de cada partida (semilla, ticks, pasos, longitud,
+ *   resultado y suma de comprobación) van en columnas separadas que
+ *   recorren los informes. El estado que se avanza tick a tick no: cada
+ *   hilo juega sus partidas una tras otra sobre un tablero y un mundo
+ *   propios, que son las estructuras del motor tal cual, reutilizadas
+ *   de una partida a la siguiente.
+ *
+ *   Las semillas solo dependen de la semilla base y del índice de la
+ *   partida, y el piloto automático se compila sin presupuesto de tiempo
+ *   (AUTOPILOT_BUDGET=0), así que los resultados no dependen del número
+ *   de hilos: la suma de comprobación de cada pasada debe coincidir.
+ *
+ *   Con -w el tablero es toroidal (sin bordes): las partidas duran mucho
+ *   más y son la carga más pesada.
+ *
+ *   Con -x se repite el lote doblando el número de serpientes (1, 2, 4...
+ *   hasta -K) para ver cómo escala el coste del tick con las entidades.
+ *
+ *   Con -f se sale con 1 si alguna partida acaba en muerte: con el ciclo
+ *   hamiltoniano el piloto automático debe llenar siempre el tablero.
+ *
+ *   Uso: snake_batch [-n partidas] [-t hilos] [-m auto|script]
+ *                    [-s semilla] [-k ticks máximos]
+ *                    [-K serpientes] [-M manzanas] [-w] [-x] [-f]
+ */
+#define SNAKE_NO_MAIN
+#include "../snake.c"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "harness.h"
+
+/*─── CONFIGURACIÓN ─────────────────────────────────────────────────────────*/
+#define BATCH_CHUNK     16          // partidas por lote de trabajo
+#define MAX_THREADS     64
+#define HISTOGRAM_BINS  10          // tramos del histograma de longitudes
+
+// Resultado final de cada partida
+enum { GAME_RUNNING, GAME_DEAD, GAME_WON, GAME_TIMEOUT };
+
+typedef enum { MODE_AUTO, MODE_SCRIPT } BatchMode;
+
+/*─── ESTADO DEL LOTE ───────────────────────────────────────────────────────*/
+static int            nGames      = 1024;
+static unsigned int   baseSeed    = 12345;
+static unsigned int   maxTicks    = 100000;
+static BatchMode      mode        = MODE_AUTO;
+static int            snakeCount  = 1;
+static int            appleCount  = 1;
+static int            wrap        = WRAP_EDGES;
+
+static BoardType*     boards;       // un tablero por hilo (se reutiliza)
+static WorldType*     worlds;       // un mundo por hilo
+static unsigned int*  seeds;        // semilla de cada partida
+static unsigned int*  ticks;        // ticks jugados
+static unsigned int*  moves;        // pasos de serpiente (vivas × ticks)
+static unsigned short* lengths;     // suma de longitudes al final
+static unsigned char* outcomes;     // GAME_*
+static unsigned int*  checksums;    // boardChecksum al terminar
+
+// Rango de lotes pendiente de cada hilo: inicio en los 32 bits bajos y
+// fin (exclusivo) en los altos. Cada uno en su propia línea de caché.
+typedef struct {
+    _Alignas(64) _Atomic unsigned long long range;
+} WorkQueue;
+
+typedef struct {
+    int            id;
+    int            nThreads;
+    unsigned int   chunks;          // lotes ejecutados
+    unsigned int   stolen;          // de ellos, robados
+    AutopilotType  autopilot;       // búferes de búsqueda propios
+} Worker;
+
+static WorkQueue      queues[MAX_THREADS];
+static Worker         workers[MAX_THREADS];
+
+/*─── COLA DE TRABAJO ───────────────────────────────────────────────────────*/
+
+static unsigned long long packRange(unsigned int lo, unsigned int hi) {
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/**
+ * takeChunk:
+ *   El dueño del rango toma el primer lote. Devuelve -1 si está vacío.
+ */
+static int takeChunk(WorkQueue* q) {
+    unsigned long long r = atomic_load(&q->range);
+    for (;;) {
+        unsigned int lo = (unsigned int)r, hi = (unsigned int)(r >> 32);
+        if (lo >= hi) return -1;
+        if (atomic_compare_exchange_weak(&q->range, &r, packRange(lo + 1, hi)))
+            return (int)lo;
+    }
+}
+
+/**
+ * stealChunk:
+ *   Otro hilo roba el último lote del rango, lejos de donde trabaja el
+ *   dueño. Devuelve -1 si está vacío.
+ */
+static int stealChunk(WorkQueue* q) {
+    unsigned long long r = atomic_load(&q->range);
+    for (;;) {
+        unsigned int lo = (unsigned int)r, hi = (unsigned int)(r >> 32);
+        if (lo >= hi) return -1;
+        if (atomic_compare_exchange_weak(&q->range, &r, packRange(lo, hi - 1)))
+            return (int)(hi - 1);
+    }
+}
+
+/*─── SIMULACIÓN ────────────────────────────────────────────────────────────*/
+
+/**
+ * playGame:
+ *   Juega la partida g hasta que no queda ninguna serpiente (o hasta
+ *   maxTicks) sobre el tablero y el mundo del hilo y guarda su resultado.
+ */
+static void playGame(Worker* w, int g) {
+    BoardType*   board = &boards[w->id];
+    WorldType*   world = &worlds[w->id];
+    unsigned int t = 0, moved = 0;
+    int          total = 0;
+    StepResult   result = STEP_MOVED;
+
+    resetBoard(board);
+    resetWorld(world, board, snakeCount, appleCount, seeds[g]);
+    for (int i = 0; i < snakeCount; i++)
+        world->control[i] = mode == MODE_AUTO ? CONTROL_AI : CONTROL_SCRIPT;
+
+    while (t < maxTicks) {
+        steerSnakes(world, &w->autopilot);
+        moved += (unsigned int)world->liveCount;
+        result = stepWorld(world);
+        t++;
+        if (result == STEP_DEAD || result == STEP_WON) break;
+    }
+    for (int i = 0; i < snakeCount; i++) total += world->snakes[i].length;
+
+    ticks[g]     = t;
+    moves[g]     = moved;
+    lengths[g]   = (unsigned short)total;
+    outcomes[g]  = result == STEP_DEAD ? GAME_DEAD
+                 : result == STEP_WON  ? GAME_WON : GAME_TIMEOUT;
+    checksums[g] = boardChecksum(board);
+}
+
+static void runChunk(Worker* w, int c) {
+    int end = (c + 1) * BATCH_CHUNK < nGames ? (c + 1) * BATCH_CHUNK : nGames;
+    for (int g = c * BATCH_CHUNK; g < end; g++)
+        playGame(w, g);
+    w->chunks++;
+}
+
+/**
+ * workerMain:
+ *   Consume el rango propio y después roba a los demás hilos, empezando
+ *   por el siguiente, hasta que no queda trabajo en ninguno.
+ */
+static void* workerMain(void* arg) {
+    Worker* w = (Worker*)arg;
+    int c;
+
+    for (;;) {
+        while ((c = takeChunk(&queues[w->id])) >= 0)
+            runChunk(w, c);
+
+        int found = 0;
+        for (int k = 1; k < w->nThreads && !found; k++) {
+            int victim = (w->id + k) % w->nThreads;
+            if ((c = stealChunk(&queues[victim])) >= 0) {
+                w->stolen++;
+                runChunk(w, c);
+                found = 1;
+            }
+        }
+        if (!found) return NULL;
+    }
+}
+
+/**
+ * runBatch:
+ *   Juega todas las partidas con nThreads hilos y devuelve los segundos
+ *   de pared empleados.
+ */
+static double runBatch(int nThreads) {
+    int nChunks = (nGames + BATCH_CHUNK - 1) / BATCH_CHUNK;
+    pthread_t threads[MAX_THREADS];
+
+    // Rangos iniciales contiguos y del mismo tamaño
+    for (int i = 0; i < nThreads; i++) {
+        unsigned int lo = (unsigned int)((long long)nChunks * i / nThreads);
+        unsigned int hi = (unsigned int)((long long)nChunks * (i + 1) / nThreads);
+        atomic_store(&queues[i].range, packRange(lo, hi));
+        workers[i].nThreads = nThreads;
+        workers[i].chunks   = 0;
+        workers[i].stolen   = 0;
+    }
+
+    double start = nowSeconds();
+    for (int i = 1; i < nThreads; i++)
+        pthread_create(&threads[i], NULL, workerMain, &workers[i]);
+    workerMain(&workers[0]);
+    for (int i = 1; i < nThreads; i++)
+        pthread_join(threads[i], NULL);
+    return nowSeconds() - start;
+}
+
+/*─── INFORMES ──────────────────────────────────────────────────────────────*/
+
+static int compareUint(const void* a, const void* b) {
+    unsigned int x = *(const unsigned int*)a, y = *(const unsigned int*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * printDistribution:
+ *   Resume una columna del lote: mínimo, percentiles, máximo y media.
+ */
+static void printDistribution(const char* name, unsigned int* values, int n) {
+    unsigned long long sum = 0;
+    qsort(values, n, sizeof(*values), compareUint);
+    for (int i = 0; i < n; i++) sum += values[i];
+    printf("%-9s min=%u p50=%u p90=%u p99=%u max=%u media=%.1f\n", name,
+           values[0], values[n / 2], values[n * 9 / 10], values[n * 99 / 100],
+           values[n - 1], (double)sum / n);
+}
+
+/**
+ * printReport:
+ *   Resultados, distribuciones e histograma de longitudes del lote.
+ *   Devuelve las partidas que acabaron en muerte.
+ */
+static int printReport(void) {
+    unsigned int* column = malloc(sizeof(*column) * nGames);
+    int count[4] = { 0 };
+    int bins[HISTOGRAM_BINS] = { 0 };
+
+    for (int g = 0; g < nGames; g++) {
+        count[outcomes[g]]++;
+        bins[(lengths[g] - 1) * HISTOGRAM_BINS / MAX_BLOCKS]++;
+    }
+    printf("resultados: victorias=%d muertes=%d sin_terminar=%d\n",
+           count[GAME_WON], count[GAME_DEAD], count[GAME_TIMEOUT]);
+
+    for (int g = 0; g < nGames; g++) column[g] = ticks[g];
+    printDistribution("ticks", column, nGames);
+    for (int g = 0; g < nGames; g++) column[g] = lengths[g];
+    printDistribution("longitud", column, nGames);
+
+    printf("histograma de longitud total (%d bloques):\n", MAX_BLOCKS);
+    for (int b = 0; b < HISTOGRAM_BINS; b++) {
+        int lo = b * MAX_BLOCKS / HISTOGRAM_BINS + 1;
+        int hi = (b + 1) * MAX_BLOCKS / HISTOGRAM_BINS;
+        int bar = (int)(60LL * bins[b] / nGames);
+        printf("  %4d-%-4d %6d ", lo, hi, bins[b]);
+        for (int i = 0; i < bar; i++) putchar('#');
+        putchar('\n');
+    }
+    free(column);
+    return count[GAME_DEAD];
+}
+
+static unsigned int batchChecksum(unsigned long long* totalTicks,
+                                  unsigned long long* totalMoves) {
+    unsigned int h = 2166136261u;
+    *totalTicks = *totalMoves = 0;
+    for (int g = 0; g < nGames; g++) {
+        *totalTicks += ticks[g];
+        *totalMoves += moves[g];
+        h = (h ^ checksums[g]) * 16777619u;
+        h = (h ^ ticks[g]) * 16777619u;
+    }
+    return h;
+}
+
+/*─── FUNCIÓN PRINCIPAL ─────────────────────────────────────────────────────*/
+int main(int argc, char** argv) {
+    int maxThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int sweep = 0, failOnDeath = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:t:m:s:k:K:M:wxf")) != -1) {
+        switch (opt) {
+        case 'K': snakeCount = atoi(optarg); break;
+        case 'M': appleCount = atoi(optarg); break;
+        case 'w': wrap       = 1; break;
+        case 'x': sweep      = 1; break;
+        case 'f': failOnDeath = 1; break;
+        case 'n': nGames     = atoi(optarg); break;
+        case 't': maxThreads = atoi(optarg); break;
+        case 's': baseSeed   = (unsigned int)strtoul(optarg, NULL, 0); break;
+        case 'k': maxTicks   = (unsigned int)strtoul(optarg, NULL, 0); break;
+        case 'm':
+            if      (!strcmp(optarg, "auto"))   mode = MODE_AUTO;
+            else if (!strcmp(optarg, "script")) mode = MODE_SCRIPT;
+            else { fprintf(stderr, "modo desconocido: %s\n", optarg); return 2; }
+            break;
+        default:
+            fprintf(stderr, "uso: %s [-n partidas] [-t hilos] [-m auto|script]"
+                            " [-s semilla] [-k ticks] [-K serpientes] [-M manzanas]"
+                            " [-w] [-x] [-f]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (nGames < 1) nGames = 1;
+    if (maxThreads < 1) maxThreads = 1;
+    if (maxThreads > MAX_THREADS) maxThreads = MAX_THREADS;
+    if (snakeCount < 1 || snakeCount > MAX_SNAKES || appleCount < 1 || appleCount > MAX_APPLES) {
+        fprintf(stderr, "serpientes 1..%d y manzanas 1..%d\n", MAX_SNAKES, MAX_APPLES);
+        return 2;
+    }
+
+    initializeBoardTables(wrap);
+    boards    = malloc(sizeof(*boards) * maxThreads);
+    worlds    = malloc(sizeof(*worlds) * maxThreads);
+    seeds     = malloc(sizeof(*seeds) * nGames);
+    ticks     = malloc(sizeof(*ticks) * nGames);
+    moves     = malloc(sizeof(*moves) * nGames);
+    lengths   = malloc(sizeof(*lengths) * nGames);
+    outcomes  = malloc(sizeof(*outcomes) * nGames);
+    checksums = malloc(sizeof(*checksums) * nGames);
+    for (int i = 0; i < maxThreads; i++) {
+        workers[i].id = i;
+        initializeBoard(&boards[i], NULL);
+        initializeWorld(&worlds[i]);
+        initializeAutopilot(&workers[i].autopilot, &boards[i]);
+    }
+    for (int g = 0; g < nGames; g++) seeds[g] = gameSeed(baseSeed, g);
+
+    printf("lote: partidas=%d tablero=%dx%d%s serpientes=%d manzanas=%d modo=%s"
+           " semilla=%u ticks_max=%u\n", nGames, BLOCK_COLS, BLOCK_ROWS,
+           wrap ? " toroidal" : "", snakeCount,
+           appleCount, mode == MODE_AUTO ? "auto" : "script", baseSeed, maxTicks);
+
+    // Escalado con las entidades: mismas partidas con 1, 2, 4... serpientes
+    if (sweep) {
+        int maxSnakes = snakeCount;
+        for (snakeCount = 1; ; snakeCount = snakeCount * 2 > maxSnakes &&
+                                            snakeCount < maxSnakes ? maxSnakes : snakeCount * 2) {
+            unsigned long long totalTicks, totalMoves;
+            double secs = runBatch(maxThreads);
+            batchChecksum(&totalTicks, &totalMoves);
+            printf("serpientes=%-3d ticks/s=%.0f pasos/s=%.0f ns/paso=%.1f\n", snakeCount,
+                   totalTicks / secs, totalMoves / secs, secs * 1e9 / totalMoves);
+            if (snakeCount >= maxSnakes) break;
+        }
+        return 0;
+    }
+
+    // Escalado: 1, 2, 4... hilos hasta el máximo (incluido siempre)
+    double base = 0;
+    for (int t = 1; ; t = t * 2 > maxThreads && t < maxThreads ? maxThreads : t * 2) {
+        unsigned long long totalTicks, totalMoves;
+        double secs = runBatch(t);
+        unsigned int sum = batchChecksum(&totalTicks, &totalMoves);
+        unsigned int stolen = 0;
+        for (int i = 0; i < t; i++) stolen += workers[i].stolen;
+        if (t == 1) base = secs;
+        printf("hilos=%-3d ticks=%llu tiempo=%.3fs ticks/s=%.0f pasos/s=%.0f"
+               " aceleracion=%.2fx robos=%u checksum=%08x\n", t, totalTicks, secs,
+               totalTicks / secs, totalMoves / secs, base / secs, stolen, sum);
+        if (t >= maxThreads) break;
+    }
+
+    int deaths = printReport();
+    if (failOnDeath && deaths > 0) {
+        printf("FALLO: %d partidas acabaron en muerte\n", deaths);
+        return 1;
+    }
+    return 0;
+}
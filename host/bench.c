@@ -0,0 +1,470 @@
+/*
+ * bench.c
+ *
+ *   Banco de pruebas de rendimiento para el host: pasa cargas fijas y
+ *   sembradas por el motor de snake.c (incluido con SNAKE_NO_MAIN) con el
+ *   mismo orden de tareas por tick que main: instantánea de rebobinado,
+ *   muestreo del D-Pad, dirección, stepWorld y volcado a la matriz LED
+ *   (bloques y marcador).
+ *
+ *   Cargas:
+ *     early    principio de partida: serpiente corta guionizada, se
+ *              reinicia cada EARLY_TICKS ticks
+ *     late     tablero casi lleno: la serpiente se monta ya larga sobre
+ *              un recorrido en zigzag que cubre el tablero y lo sigue con
+ *              LATE_APPLES manzanas, que se reponen en los pocos bloques
+ *              libres (updateApple con el conjunto libre casi vacío)
+ *     long     partidas completas con el piloto automático
+ *     restart  reinicios seguidos como los de main (apagar lo encendido,
+ *              rehacer la rejilla y el mundo) con RESTART_TICKS ticks de
+ *              juego entre uno y otro; aquí el reinicio sí se cronometra
+ *
+ *   De cada carga se mide: ticks por segundo (el mejor de -r repeticiones),
+ *   lecturas y escrituras MMIO por tick, reservas de memoria dinámica por
+ *   tick (malloc/calloc/realloc llamados desde el juego, que se enlaza con
+ *   --wrap) y el pico de memoria del juego: su huella estática en el
+ *   peor caso (GAME_FOOTPRINT, la misma que informa make) más el máximo
+ *   de memoria dinámica viva. La memoria residente del proceso se
+ *   muestra pero no se compara (depende del entorno más que del juego).
+ *
+ *   El resultado se escribe en -o con una línea por carga, en pares
+ *   clave=valor (-c deja solo los contadores). Se sale con 1 si alguna
+ *   métrica empeora más de su tolerancia frente a:
+ *     -b  una línea base guardada: solo los contadores, que son
+ *         deterministas (semillas fijas y piloto sin presupuesto de
+ *         tiempo) y valen en cualquier máquina
+ *     -l  una línea base local hecha en la misma máquina: solo el ritmo
+ *         de ticks, con el margen de -T
+ *
+ *   Uso: snake_bench [-s semilla] [-r repeticiones] [-o salida] [-c]
+ *                    [-b línea base] [-l línea base local] [-T tolerancia %]
+ */
+#define SNAKE_NO_MAIN
+#include "../snake.c"
+
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <sys/resource.h>
+
+#include "harness.h"
+
+/*─── CONFIGURACIÓN ─────────────────────────────────────────────────────────*/
+#define EARLY_GAMES     4000
+#define EARLY_TICKS     64          // ticks de cada partida corta
+#define LATE_GAMES      2000
+#define LATE_FILL_PCT   85          // ocupación del tablero al empezar
+#define LATE_APPLES     4
+#define LONG_GAMES      16
+#define LONG_MAX_TICKS  20000       // corta las partidas que entran en bucle
+#define RESTART_GAMES   4000
+#define RESTART_TICKS   8
+#define MAX_WORKLOADS   4
+
+#if MAX_APPLES < LATE_APPLES
+#error "La carga late necesita MAX_APPLES >= LATE_APPLES"
+#endif
+
+/*─── CONTADOR DE RESERVAS ──────────────────────────────────────────────────*/
+// El enlazador redirige a estas funciones las llamadas del juego (y del
+// banco) a malloc, calloc, realloc y free; las de la propia libc no se
+// cuentan. Los bytes vivos salen del tamaño real de cada bloque.
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t size);
+void  __real_free(void* p);
+
+static unsigned long long heapAllocs;
+static size_t             heapLive, heapPeak;
+
+static void* countAlloc(void* p) {
+    heapAllocs++;
+    heapLive += p ? malloc_usable_size(p) : 0;
+    if (heapLive > heapPeak) heapPeak = heapLive;
+    return p;
+}
+
+void* __wrap_malloc(size_t size)            { return countAlloc(__real_malloc(size)); }
+void* __wrap_calloc(size_t n, size_t size)  { return countAlloc(__real_calloc(n, size)); }
+void* __wrap_realloc(void* p, size_t size) {
+    heapLive -= p ? malloc_usable_size(p) : 0;
+    return countAlloc(__real_realloc(p, size));
+}
+void __wrap_free(void* p) {
+    heapLive -= p ? malloc_usable_size(p) : 0;
+    __real_free(p);
+}
+
+/*─── ESTADO DEL BANCO ──────────────────────────────────────────────────────*/
+typedef struct {
+    const char*        name;
+    unsigned long long ticks;
+    double             seconds;         // mejor repetición
+    unsigned long long mmioReads;
+    unsigned long long mmioWrites;
+    unsigned long long allocs;
+    size_t             peakBytes;       // GAME_FOOTPRINT + pico dinámico
+    long               rssKb;           // pico residente del proceso
+} Result;
+
+// Métricas que se guardan y comparan: las de "más es mejor" empeoran al
+// bajar; el resto al subir. Las que dependen de la máquina solo se
+// comparan con una línea base local
+typedef struct {
+    const char* key;
+    int         higherIsBetter;
+    int         machineDependent;
+    double      tolerancePct;           // < 0: la de -T
+} Metric;
+
+static const Metric metrics[] = {
+    { "ticks_per_s",          1, 1, -1 },
+    { "mmio_reads_per_tick",  0, 0,  1 },
+    { "mmio_writes_per_tick", 0, 0,  1 },
+    { "allocs_per_tick",      0, 0,  0 },
+    { "peak_mem_bytes",       0, 0,  0 },
+};
+#define METRIC_COUNT ((int)(sizeof(metrics) / sizeof(metrics[0])))
+
+static unsigned int baseSeed = 12345;
+static int          repeats  = 5;
+
+static BoardType     board;
+static WorldType     world;
+static AutopilotType autopilot;
+static InputType     input;
+static RewindType    history;
+#if HUD_HEIGHT
+static HudType       hud;
+#endif
+static unsigned long long mmioWrites;
+
+// Dirección de cada bloque en el recorrido en zigzag de la carga late:
+// filas pares hacia la derecha, impares hacia la izquierda, y abajo al
+// llegar al extremo
+static unsigned char zigzagDir[MAX_BLOCKS];
+
+/*─── TAREAS DEL TICK ───────────────────────────────────────────────────────*/
+
+/**
+ * restartGame:
+ *   Reinicio como el de main: apaga por tramos lo que quedó encendido,
+ *   rehace la rejilla y coloca serpientes y manzanas. El jugador lo
+ *   lleva `control` en vez del D-Pad. Devuelve las escrituras MMIO del
+ *   apagado, que solo cuenta la carga que cronometra el reinicio.
+ */
+static unsigned long long restartGame(unsigned int seed, int apples, ControlType control) {
+    unsigned long long writes = 0;
+    while (clearTouched(&board, RESTART_SLICE) > 0)
+        writes += board.mmioWrites;
+    writes += board.mmioWrites;
+    resetBoard(&board);
+    resetWorld(&world, &board, 1, apples, seed);
+    resetRewind(&history);
+    resetInput(&input, DOWN);
+    world.control[0] = (unsigned char)control;
+    return writes;
+}
+
+/**
+ * playTick:
+ *   Un tick de juego y su volcado, en el orden de main.
+ */
+static StepResult playTick(void) {
+    rewindPush(&history, &world);
+    sampleInput(&input);
+    steerSnakes(&world, &autopilot);
+    StepResult result = stepWorld(&world);
+    if (board.dirtyCount)
+        mmioWrites += renderFlush(&board);
+#if HUD_HEIGHT
+    mmioWrites += updateHud(&hud, (unsigned int)world.snakes[0].length);
+#endif
+    return result;
+}
+
+static int gameOver(StepResult result) {
+    return result == STEP_DEAD || result == STEP_WON;
+}
+
+/*─── CARGAS ────────────────────────────────────────────────────────────────*/
+// Cada carga devuelve los ticks jugados y acumula en `seconds` y en
+// mmioWrites solo lo de los tramos que mide
+
+static unsigned long long runEarly(double* seconds) {
+    unsigned long long t = 0;
+    for (int g = 0; g < EARLY_GAMES; g++) {
+        restartGame(gameSeed(baseSeed, g), 1, CONTROL_SCRIPT);
+        double start = nowSeconds();
+        for (int i = 0; i < EARLY_TICKS; i++) {
+            t++;
+            if (gameOver(playTick())) break;
+        }
+        *seconds += nowSeconds() - start;
+    }
+    return t;
+}
+
+/**
+ * runLate:
+ *   Monta la serpiente sobre el zigzag hasta LATE_FILL_PCT del tablero
+ *   (sin medir) y la hace seguirlo hasta que se acaba el recorrido o el
+ *   tablero se llena.
+ */
+static unsigned long long runLate(double* seconds) {
+    unsigned long long t = 0;
+    int fill = MAX_BLOCKS * LATE_FILL_PCT / 100;
+
+    for (int g = 0; g < LATE_GAMES; g++) {
+        restartGame(gameSeed(baseSeed, g), 0, CONTROL_DPAD);
+        SnakeType* s = &world.snakes[0];
+        while (s->length < fill)
+            growSnake(s, &board, (motion)zigzagDir[s->head]);
+        world.appleCount = LATE_APPLES;
+        for (int k = 0; k < LATE_APPLES; k++) {
+            world.apples[k].block = -1;
+            updateApple(&world.apples[k], &board, &world.rng);
+        }
+        renderFlush(&board);
+
+        double start = nowSeconds();
+        StepResult result = STEP_MOVED;
+        while (!gameOver(result)) {
+            world.dir[0] = zigzagDir[s->head];
+            result = playTick();
+            t++;
+        }
+        *seconds += nowSeconds() - start;
+    }
+    return t;
+}
+
+static unsigned long long runLong(double* seconds) {
+    unsigned long long t = 0;
+    for (int g = 0; g < LONG_GAMES; g++) {
+        restartGame(gameSeed(baseSeed, g), 1, CONTROL_AI);
+        double start = nowSeconds();
+        for (int i = 0; i < LONG_MAX_TICKS; i++) {
+            t++;
+            if (gameOver(playTick())) break;
+        }
+        *seconds += nowSeconds() - start;
+    }
+    return t;
+}
+
+static unsigned long long runRestart(double* seconds) {
+    unsigned long long t = 0;
+    double start = nowSeconds();
+    for (int g = 0; g < RESTART_GAMES; g++) {
+        mmioWrites += restartGame(gameSeed(baseSeed, g), 1, CONTROL_SCRIPT);
+        for (int i = 0; i < RESTART_TICKS; i++) {
+            t++;
+            if (gameOver(playTick())) break;
+        }
+    }
+    *seconds += nowSeconds() - start;
+    return t;
+}
+
+/**
+ * runWorkload:
+ *   Ejecuta la carga `repeats` veces y se queda con la más rápida. Los
+ *   contadores se toman de la última (son iguales en todas).
+ */
+static Result runWorkload(const char* name, unsigned long long (*run)(double*)) {
+    Result r = { name, 0, 0, 0, 0, 0, 0, 0 };
+    struct rusage usage;
+
+    for (int i = 0; i < repeats; i++) {
+        double secs = 0;
+        unsigned int reads = input.mmioReads;
+        unsigned long long allocs = heapAllocs;
+        mmioWrites = 0;
+        heapPeak   = heapLive;
+
+        r.ticks      = run(&secs);
+        r.mmioReads  = input.mmioReads - reads;
+        r.mmioWrites = mmioWrites;
+        r.allocs     = heapAllocs - allocs;
+        r.peakBytes  = GAME_FOOTPRINT + heapPeak;
+        if (i == 0 || secs < r.seconds) r.seconds = secs;
+    }
+    getrusage(RUSAGE_SELF, &usage);
+    r.rssKb = usage.ru_maxrss;
+    return r;
+}
+
+/*─── INFORMES ──────────────────────────────────────────────────────────────*/
+
+static double metricValue(const Result* r, int m) {
+    double ticks = r->ticks ? (double)r->ticks : 1;
+    switch (m) {
+    case 0:  return r->ticks / r->seconds;
+    case 1:  return r->mmioReads / ticks;
+    case 2:  return r->mmioWrites / ticks;
+    case 3:  return r->allocs / ticks;
+    default: return (double)r->peakBytes;
+    }
+}
+
+/**
+ * header:
+ *   Primera línea de los resultados: la configuración con la que son
+ *   comparables (tablero y semilla).
+ */
+static const char* header(void) {
+    static char line[64];
+    snprintf(line, sizeof(line), "# snake_bench tablero=%dx%d semilla=%u",
+             BLOCK_COLS, BLOCK_ROWS, baseSeed);
+    return line;
+}
+
+/**
+ * writeResults:
+ *   Una línea por carga: nombre y pares clave=valor de cada métrica, o
+ *   solo de las que no dependen de la máquina si `countersOnly`.
+ */
+static int writeResults(const char* path, const Result* results, int n, int countersOnly) {
+    FILE* f = path ? fopen(path, "w") : stdout;
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+    fprintf(f, "%s\n", header());
+    for (int w = 0; w < n; w++) {
+        fprintf(f, "%s", results[w].name);
+        for (int m = 0; m < METRIC_COUNT; m++)
+            if (!countersOnly || !metrics[m].machineDependent)
+                fprintf(f, " %s=%.4f", metrics[m].key, metricValue(&results[w], m));
+        fputc('\n', f);
+    }
+    if (path) fclose(f);
+    return 1;
+}
+
+/**
+ * compareBaseline:
+ *   Lee la línea base y compara, de cada carga que aparece en ella, las
+ *   métricas que dependen de la máquina (`local`) o las que no. Devuelve
+ *   el número de regresiones, o -1 si no se puede leer o es de otra
+ *   configuración.
+ */
+static int compareBaseline(const char* path, const Result* results, int n,
+                           int local, double timeTolerance) {
+    char line[512];
+    int regressions = 0;
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char name[32];
+        int offset;
+        if (line[0] == '#') {
+            if (strncmp(line, header(), strlen(header())) != 0) {
+                fprintf(stderr, "%s: línea base de otra configuración\n", path);
+                fclose(f);
+                return -1;
+            }
+            continue;
+        }
+        if (sscanf(line, "%31s%n", name, &offset) != 1) continue;
+
+        const Result* r = NULL;
+        for (int w = 0; w < n; w++)
+            if (!strcmp(results[w].name, name)) r = &results[w];
+        if (!r) continue;
+
+        for (int m = 0; m < METRIC_COUNT; m++) {
+            char* field = strstr(line + offset, metrics[m].key);
+            double base, value = metricValue(r, m);
+            if (metrics[m].machineDependent != local) continue;
+            if (!field || sscanf(field + strlen(metrics[m].key), "=%lf", &base) != 1) continue;
+
+            double tol = (metrics[m].tolerancePct < 0 ? timeTolerance : metrics[m].tolerancePct) / 100;
+            int worse = metrics[m].higherIsBetter ? value < base * (1 - tol)
+                                                  : value > base * (1 + tol);
+            if (worse) {
+                printf("REGRESIÓN %s %s: %.4f frente a %.4f (tolerancia %.0f%%)\n",
+                       name, metrics[m].key, value, base, tol * 100);
+                regressions++;
+            }
+        }
+    }
+    fclose(f);
+    return regressions;
+}
+
+/*─── FUNCIÓN PRINCIPAL ─────────────────────────────────────────────────────*/
+int main(int argc, char** argv) {
+    const char* outPath  = NULL;
+    const char* basePath = NULL;
+    const char* localPath = NULL;
+    double timeTolerance = 25;
+    int countersOnly = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:r:o:cb:l:T:")) != -1) {
+        switch (opt) {
+        case 's': baseSeed      = (unsigned int)strtoul(optarg, NULL, 0); break;
+        case 'r': repeats       = atoi(optarg); break;
+        case 'o': outPath       = optarg; break;
+        case 'c': countersOnly  = 1; break;
+        case 'b': basePath      = optarg; break;
+        case 'l': localPath     = optarg; break;
+        case 'T': timeTolerance = atof(optarg); break;
+        default:
+            fprintf(stderr, "uso: %s [-s semilla] [-r repeticiones] [-o salida] [-c]"
+                            " [-b línea base] [-l línea base local] [-T tolerancia %%]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (repeats < 1) repeats = 1;
+
+    // La matriz empieza apagada, como tras limpiarPantalla en main
+    volatile unsigned int* ledBase = LED_MATRIX_0_BASE;
+    limpiarPantalla(ledBase, LED_MATRIX_0_WIDTH, LED_MATRIX_0_HEIGHT);
+    initializeBoardTables(WRAP_EDGES);
+    initializeBoard(&board, ledBase);
+    initializeWorld(&world);
+    initializeAutopilot(&autopilot, &board);
+    initializeInput(&input);
+#if HUD_HEIGHT
+    initializeHud(&hud, ledBase, LED_MATRIX_0_WIDTH);
+#endif
+    for (int b = 0; b < MAX_BLOCKS; b++) {
+        int x = b % BLOCK_COLS, y = b / BLOCK_COLS;
+        int end = y % 2 == 0 ? x == BLOCK_COLS - 1 : x == 0;
+        zigzagDir[b] = (unsigned char)(end ? DOWN : y % 2 == 0 ? RIGHT : LEFT);
+    }
+
+    Result results[MAX_WORKLOADS];
+    int n = 0;
+    results[n++] = runWorkload("early",   runEarly);
+    results[n++] = runWorkload("late",    runLate);
+    results[n++] = runWorkload("long",    runLong);
+    results[n++] = runWorkload("restart", runRestart);
+
+    for (int w = 0; w < n; w++)
+        printf("%-8s ticks=%-8llu ticks/s=%-10.0f lecturas/tick=%.2f escrituras/tick=%.2f"
+               " reservas/tick=%.3f memoria=%zuB residente=%ldkB\n", results[w].name,
+               results[w].ticks, metricValue(&results[w], 0), metricValue(&results[w], 1),
+               metricValue(&results[w], 2), metricValue(&results[w], 3),
+               results[w].peakBytes, results[w].rssKb);
+
+    if (outPath && !writeResults(outPath, results, n, countersOnly)) return 2;
+
+    int regressions = 0;
+    const char* paths[2] = { basePath, localPath };
+    for (int local = 0; local < 2; local++) {
+        if (!paths[local]) continue;
+        int found = compareBaseline(paths[local], results, n, local, timeTolerance);
+        if (found < 0) return 2;
+        if (found == 0) printf("sin regresiones frente a %s\n", paths[local]);
+        regressions += found;
+    }
+    return regressions > 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * footprint.c
+ *
+ *   Informe de la RAM que usa el juego en el peor caso (GAME_FOOTPRINT),
+ *   desglosada por componente. Se compila con las mismas opciones que el
+ *   juego y se ejecuta al construir, así que cualquier cambio de tamaño
+ *   (dimensiones del tablero, capacidad del mundo, rebobinado...) se ve
+ *   en la salida de make. El límite lo impone snake.c con RAM_BUDGET.
+ *
+ *   Los tamaños son los del ABI del host: en RV32 los pocos punteros
+ *   ocupan la mitad, así que la cifra real es igual o algo menor.
+ */
+#define SNAKE_NO_MAIN
+#include "../snake.c"
+
+static void line(const char* name, unsigned long bytes) {
+    printf("  %-22s %7lu\n", name, bytes);
+}
+
+int main(void) {
+    printf("huella de RAM del juego (tablero %dx%d bloques):\n", BLOCK_COLS, BLOCK_ROWS);
+    line("tablero",            sizeof(BoardType));
+    line("mundo",              sizeof(WorldType));
+    line("piloto automático",  sizeof(AutopilotType));
+    line("rebobinado",         sizeof(RewindType));
+    line("grabaciones",        2 * sizeof(RecordingType));
+    line("resto del estado",   sizeof(ArenaType) - sizeof(BoardType) - sizeof(WorldType)
+                               - sizeof(AutopilotType) - sizeof(RewindType)
+                               - 2 * sizeof(RecordingType));
+    line("tablas de pasos",    sizeof(stepTable) + sizeof(ledOffsetTable));
+    line("búferes de E/S",     RECORD_BYTES + LEVEL_BYTES);
+    line("perfilado",          PROFILE_BYTES);
+    printf("  %-22s %7lu de %lu (%.0f%%)\n", "total", (unsigned long)GAME_FOOTPRINT,
+           (unsigned long)RAM_BUDGET, 100.0 * GAME_FOOTPRINT / RAM_BUDGET);
+    return 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * harness.h
+ *
+ *   Utilidades que comparten el simulador por lotes (batch.c) y el banco
+ *   de pruebas (bench.c). La derivación de semillas tiene que ser la
+ *   misma en los dos para que la partida g sea la misma partida en
+ *   ambos, así que vive solo aquí.
+ */
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <time.h>
+
+/**
+ * gameSeed:
+ *   Semilla de la partida g derivada de la semilla base (mezcla de
+ *   splitmix32), independiente del hilo o la carga que la juegue.
+ */
+static inline unsigned int gameSeed(unsigned int base, int g) {
+    unsigned int z = base + (unsigned int)g * 0x9E3779B9u;
+    z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+    z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+    return z ^ (z >> 16);
+}
+
+/**
+ * nowSeconds:
+ *   Reloj monótono en segundos, para medir tramos de tiempo de pared.
+ */
+static inline double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif /* HARNESS_H */
@@ -0,0 +1,231 @@
+/*
+ * ripes_host.c
+ *
+ *   Respaldo en RAM de los periféricos de Ripes y driver de entrada por
+ *   guion para ejecutar snake.c sin cabeza (headless) en el host.
+ *
+ *   Formato del guion (fichero en RIPES_SCRIPT o, si no, stdin):
+ *     - Un token por tick, con un contador opcional delante ("12.").
+ *     - U / D / L / R : mantiene pulsada esa dirección del D-Pad.
+ *     - .             : no pulsa nada.
+ *     - S             : pulsa el switch 0 (reinicia tras GAME OVER).
+ *     - (UL)          : varias pulsaciones dentro del mismo tick; cada
+ *                       muestreo del D-Pad avanza a la siguiente.
+ *     - #             : comentario hasta fin de línea.
+ *
+ *   Variables de entorno:
+ *     RIPES_SCRIPT     Ruta del guion. Con RIPES_REPLAY o RIPES_SWITCHES
+ *                      no hace falta guion: no se pulsa nada y la
+ *                      ejecución dura hasta RIPES_MAX_STEPS.
+ *     RIPES_MAX_STEPS  Corta la ejecución tras ese número de pasos.
+ *     RIPES_DUMP       Si vale 1, vuelca la matriz LED al terminar.
+ *     RIPES_RECORD     Fichero donde guardar la grabación de cada partida.
+ *     RIPES_REPLAY     Grabación a reproducir en lugar del D-Pad.
+ *     RIPES_LEVEL      Nivel serializado (muros) con el que jugar.
+ *     RIPES_SWITCHES   Máscara de switches siempre activos (p. ej. 3 =
+ *                      SW0 + SW1: piloto automático con reinicio continuo).
+ */
+#include "ripes_system.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+volatile unsigned int ripes_host_led_matrix[LED_MATRIX_0_WIDTH * LED_MATRIX_0_HEIGHT];
+volatile unsigned int ripes_host_switches;
+volatile unsigned int ripes_host_d_pad[4];
+
+/*─── ESTADO DEL DRIVER ─────────────────────────────────────────────────────*/
+static FILE*         script;
+#define MAX_GROUP 8
+static char          keys[MAX_GROUP];   // teclas del token actual
+static int           nKeys;
+static int           subKey;            // tecla activa dentro del grupo
+static long          repeatLeft;
+static unsigned long steps;
+static unsigned long maxSteps;
+static int           initialized;
+static unsigned int  baseSwitches;      // switches fijados por entorno
+
+/**
+ * dumpMatrix:
+ *   Vuelca la matriz LED a stdout con un carácter por LED:
+ *   '#' serpiente, 'o' manzana, 'X' muro, '.' apagado y '*' cualquier
+ *   otro color.
+ */
+static void dumpMatrix(void) {
+    for (int y = 0; y < LED_MATRIX_0_HEIGHT; y++) {
+        for (int x = 0; x < LED_MATRIX_0_WIDTH; x++) {
+            unsigned int c = ripes_host_led_matrix[y * LED_MATRIX_0_WIDTH + x];
+            putchar(c == 0xff0000 ? '#' : c == 0x00e100 ? 'o' : c == 0x606060 ? 'X'
+                  : c == 0 ? '.' : '*');
+        }
+        putchar('\n');
+    }
+}
+
+/**
+ * finish:
+ *   Fin del guion: imprime el resumen de la ejecución y sale.
+ */
+static void finish(void) {
+    const char* dump = getenv("RIPES_DUMP");
+    printf("steps=%lu\n", steps);
+    if (dump && dump[0] == '1')
+        dumpMatrix();
+    exit(0);
+}
+
+/**
+ * initDriver:
+ *   Abre el guion y lee los límites desde el entorno (solo una vez).
+ */
+static void initDriver(void) {
+    const char* path = getenv("RIPES_SCRIPT");
+    const char* max  = getenv("RIPES_MAX_STEPS");
+    const char* sw   = getenv("RIPES_SWITCHES");
+
+    baseSwitches = sw ? (unsigned int)strtoul(sw, NULL, 0) : 0;
+    if (path)                             script = fopen(path, "r");
+    else if (getenv("RIPES_REPLAY") || sw) script = NULL;
+    else                                  script = stdin;
+    if (path && !script) {
+        perror(path);
+        exit(2);
+    }
+    maxSteps    = max ? strtoul(max, NULL, 10) : 0;
+    initialized = 1;
+}
+
+/**
+ * isKey:
+ *   Indica si `c` es una tecla válida del guion.
+ */
+static int isKey(int c) {
+    return c == 'U' || c == 'D' || c == 'L' || c == 'R' || c == '.' || c == 'S';
+}
+
+/**
+ * applyKey:
+ *   Refleja una tecla del guion en los registros del D-Pad y switches.
+ */
+static void applyKey(char key) {
+    ripes_host_d_pad[0] = key == 'U';
+    ripes_host_d_pad[1] = key == 'D';
+    ripes_host_d_pad[2] = key == 'L';
+    ripes_host_d_pad[3] = key == 'R';
+    ripes_host_switches = baseSwitches | (key == 'S' ? 0x01 : 0x00);
+}
+
+/**
+ * nextToken:
+ *   Lee el siguiente token del guion, saltando espacios y comentarios.
+ *   Devuelve 0 al llegar al final del fichero.
+ */
+static int nextToken(void) {
+    int c;
+    long count = 0;
+
+    for (;;) {
+        c = fgetc(script);
+        if (c == EOF) return 0;
+        if (c == '#') {
+            while (c != '\n' && c != EOF) c = fgetc(script);
+            continue;
+        }
+        if (c >= '0' && c <= '9') {
+            count = count * 10 + (c - '0');
+            continue;
+        }
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') continue;
+        break;
+    }
+
+    nKeys = 0;
+    if (c == '(') {
+        while ((c = fgetc(script)) != ')' && isKey(c) && nKeys < MAX_GROUP)
+            keys[nKeys++] = (char)c;
+        if (c != ')' || nKeys == 0) {
+            fprintf(stderr, "ripes_host: grupo de guion no válido\n");
+            exit(2);
+        }
+    }
+    else if (isKey(c)) {
+        keys[nKeys++] = (char)c;
+    }
+    else {
+        fprintf(stderr, "ripes_host: token de guion no válido '%c'\n", c);
+        exit(2);
+    }
+    repeatLeft = count > 0 ? count : 1;
+    return 1;
+}
+
+void ripes_host_tick(void) {
+    if (!initialized) initDriver();
+
+    if (maxSteps && steps >= maxSteps) finish();
+    if (!script) {
+        // Sin guion: nada pulsado salvo los switches fijos
+        steps++;
+        applyKey('.');
+        return;
+    }
+    if (repeatLeft == 0 && !nextToken()) finish();
+    repeatLeft--;
+    steps++;
+
+    // El primer muestreo del tick ve keys[0]; los siguientes avanzan
+    subKey = -1;
+    applyKey(keys[0]);
+}
+
+void ripes_host_save_recording(const unsigned char* buf, int len) {
+    const char* path = getenv("RIPES_RECORD");
+    if (!path) return;
+
+    FILE* f = fopen(path, "wb");
+    if (!f || fwrite(buf, 1, len, f) != (size_t)len) {
+        perror(path);
+        exit(2);
+    }
+    fclose(f);
+}
+
+int ripes_host_load_recording(unsigned char* buf, int cap) {
+    const char* path = getenv("RIPES_REPLAY");
+    if (!path) return 0;
+
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        exit(2);
+    }
+    int len = (int)fread(buf, 1, cap, f);
+    fclose(f);
+    return len;
+}
+
+int ripes_host_load_level(unsigned char* buf, int cap) {
+    const char* path = getenv("RIPES_LEVEL");
+    if (!path) return 0;
+
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        exit(2);
+    }
+    int len = (int)fread(buf, 1, cap, f);
+    fclose(f);
+    return len;
+}
+
+void ripes_host_poll(void) {
+    if (subKey + 1 < nKeys && ++subKey > 0)
+        applyKey(keys[subKey]);
+}
+
+unsigned long long ripes_host_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
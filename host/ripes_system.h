@@ -0,0 +1,101 @@
+/*
+ * ripes_system.h (versión host)
+ *
+ *   Sustituto del ripes_system.h que genera Ripes, para compilar snake.c
+ *   de forma nativa en Linux. Los periféricos mapeados en memoria
+ *   (matriz LED, D-Pad y switches) se respaldan con arrays en RAM que
+ *   gestiona host/ripes_host.c, y el D-Pad/switches se alimentan desde
+ *   un guion de entrada en lugar de la interfaz gráfica del simulador.
+ *
+ *   Las dimensiones de la matriz se pueden cambiar con -D al compilar
+ *   (por defecto las mismas que el LED matrix de Ripes: 35×25).
+ */
+#ifndef RIPES_SYSTEM_H
+#define RIPES_SYSTEM_H
+
+/*─── MATRIZ LED ────────────────────────────────────────────────────────────*/
+#ifndef LED_MATRIX_0_WIDTH
+#define LED_MATRIX_0_WIDTH  35
+#endif
+#ifndef LED_MATRIX_0_HEIGHT
+#define LED_MATRIX_0_HEIGHT 25
+#endif
+#define LED_MATRIX_0_SIZE   (LED_MATRIX_0_WIDTH * LED_MATRIX_0_HEIGHT * 4)
+
+extern volatile unsigned int ripes_host_led_matrix[LED_MATRIX_0_WIDTH * LED_MATRIX_0_HEIGHT];
+#define LED_MATRIX_0_BASE   (ripes_host_led_matrix)
+
+/*─── SWITCHES ──────────────────────────────────────────────────────────────*/
+#define SWITCHES_0_N        8
+
+extern volatile unsigned int ripes_host_switches;
+#define SWITCHES_0_BASE     (&ripes_host_switches)
+
+/*─── D-PAD ─────────────────────────────────────────────────────────────────*/
+extern volatile unsigned int ripes_host_d_pad[4];
+#define D_PAD_0_BASE        (ripes_host_d_pad)
+#define D_PAD_0_UP          (&ripes_host_d_pad[0])
+#define D_PAD_0_DOWN        (&ripes_host_d_pad[1])
+#define D_PAD_0_LEFT        (&ripes_host_d_pad[2])
+#define D_PAD_0_RIGHT       (&ripes_host_d_pad[3])
+
+/*─── DRIVER DE ENTRADA ─────────────────────────────────────────────────────*/
+
+/**
+ * ripes_host_tick:
+ *   Avanza un paso del guion de entrada: fija el estado del D-Pad y de
+ *   los switches para el siguiente tick. Al agotarse el guion imprime
+ *   un resumen (y opcionalmente la matriz) y termina el proceso.
+ */
+void ripes_host_tick(void);
+
+/**
+ * ripes_host_poll:
+ *   Se llama antes de cada muestreo del D-Pad. Dentro de un token de
+ *   grupo "(UL)" pasa a la siguiente pulsación del grupo.
+ */
+void ripes_host_poll(void);
+
+/*─── GRABACIONES ───────────────────────────────────────────────────────────*/
+
+/**
+ * ripes_host_save_recording:
+ *   Escribe una grabación serializada en el fichero RIPES_RECORD
+ *   (si está definido; cada partida sobrescribe la anterior).
+ */
+void ripes_host_save_recording(const unsigned char* buf, int len);
+
+/**
+ * ripes_host_load_recording:
+ *   Lee en `buf` la grabación del fichero RIPES_REPLAY. Devuelve su
+ *   tamaño, o 0 si no hay nada que reproducir.
+ */
+int ripes_host_load_recording(unsigned char* buf, int cap);
+
+/*─── NIVELES ──────────────────────────────────────────────────────────────*/
+
+/**
+ * ripes_host_load_level:
+ *   Lee en `buf` el nivel serializado del fichero RIPES_LEVEL. Devuelve
+ *   su tamaño, o 0 si no hay nivel.
+ */
+int ripes_host_load_level(unsigned char* buf, int cap);
+
+/*─── RELOJ ─────────────────────────────────────────────────────────────────*/
+
+/**
+ * ripes_host_clock:
+ *   Reloj monótono del host en nanosegundos; sustituye a rdcycle.
+ */
+unsigned long long ripes_host_clock(void);
+#define RIPES_HOST_CLOCK_HZ 1000000000ULL
+
+// Marca de que snake.c se está compilando para el host
+#define RIPES_HOST 1
+#define RIPES_HOST_TICK() ripes_host_tick()
+#define RIPES_HOST_POLL() ripes_host_poll()
+#define RIPES_HOST_SAVE(buf, len) ripes_host_save_recording(buf, len)
+#define RIPES_HOST_LOAD(buf, cap) ripes_host_load_recording(buf, cap)
+#define RIPES_HOST_LEVEL(buf, cap) ripes_host_load_level(buf, cap)
+
+#endif /* RIPES_SYSTEM_H */
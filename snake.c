@@ -1,94 +1,714 @@
 #include "ripes_system.h"
 #include <stdlib.h>
-
-/*─── SWITCH 0 ──────────────────────────────────────────────────────────────*/
-#define SW0 (0x01)
-
-/*─── DELAY ─────────────────────────────────────────────────────────────────*/
-#define LOOPS_PER_MS  1000
+#include <stdio.h>
+#include <string.h>
+
+/*─── HOOK DEL HOST ─────────────────────────────────────────────────────────*/
+// En la compilación nativa (host/ripes_system.h) avanza el guion de entrada;
+// en Ripes no genera código.
+#ifndef RIPES_HOST_TICK
+#define RIPES_HOST_TICK()
+#endif
+#ifndef RIPES_HOST_POLL
+#define RIPES_HOST_POLL()
+#endif
+// Persistencia de grabaciones: solo el host tiene ficheros
+#ifndef RIPES_HOST_SAVE
+#define RIPES_HOST_SAVE(buf, len)   ((void)(buf), (void)(len))
+#endif
+#ifndef RIPES_HOST_LOAD
+#define RIPES_HOST_LOAD(buf, cap)   ((void)(buf), (void)(cap), 0)
+#endif
+// Niveles desde fichero: también solo en el host
+#ifndef RIPES_HOST_LEVEL
+#define RIPES_HOST_LEVEL(buf, cap)  ((void)(buf), (void)(cap), 0)
+#endif
+
+/*─── SWITCHES ──────────────────────────────────────────────────────────────*/
+#define SW0 (0x01)      // reinicia la partida tras GAME OVER
+#define SW1 (0x02)      // activa el piloto automático
+#define SW2 (0x04)      // en GAME OVER, rebobina REWIND_TICKS ticks y sigue
+
+/*─── TEMPORIZACIÓN ────────────────────────────────────────────────────────*/
+// Frecuencia del contador de ciclos (ajustar a la del procesador simulado).
+// En el host el reloj ya viene en nanosegundos.
+#ifndef CPU_HZ
+#ifdef RIPES_HOST
+#define CPU_HZ          RIPES_HOST_CLOCK_HZ
+#else
+#define CPU_HZ          1000000ULL
+#endif
+#endif
+// Periodo fijo del tick de juego y del parpadeo de GAME OVER (0 = sin espera)
+#ifndef TICK_PERIOD_US
+#define TICK_PERIOD_US  100000
+#endif
+#ifndef BLINK_PERIOD_US
+#define BLINK_PERIOD_US 250000
+#endif
+// Bloques que apaga cada vuelta del bucle al reiniciar la partida
+#ifndef RESTART_SLICE
+#define RESTART_SLICE   32
+#endif
+
+/*─── ENTRADA ───────────────────────────────────────────────────────────────*/
+// Giros pendientes que se pueden encolar entre dos ticks
+#define TURN_QUEUE_LEN  3
+
+/*─── GRABACIÓN ─────────────────────────────────────────────────────────────*/
+// Semilla de cada partida; se puede fijar con -DGAME_SEED=n
+#ifndef GAME_SEED
+#define GAME_SEED       ((unsigned int)readCycles())
+#endif
+// Tramos RLE que caben en una grabación (2 bytes cada uno)
+#ifndef RECORD_MAX_RUNS
+#define RECORD_MAX_RUNS 4096
+#endif
+#define RECORD_MAX_RUN   0x3FFF         // 14 bits de longitud por tramo
+#define RECORD_MAGIC     0x334B4E53u    // "SNK3" en little-endian
+#define RECORD_HEADER    20             // magic, semilla, nivel, ancho, alto, bordes, tramos
+#define RECORD_BYTES     (RECORD_HEADER + 2 * RECORD_MAX_RUNS)
+
+/*─── PILOTO AUTOMÁTICO ─────────────────────────────────────────────────────*/
+// Presupuesto de cómputo por tick, en unidades de readCycles (0 = sin límite)
+#ifndef AUTOPILOT_BUDGET
+#define AUTOPILOT_BUDGET        20000
+#endif
+// Con el tablero ocupado por encima de este porcentaje ya no se toman
+// atajos hacia la manzana y se sigue el ciclo hamiltoniano tal cual
+#ifndef AUTOPILOT_SHORTCUT_PCT
+#define AUTOPILOT_SHORTCUT_PCT  50
+#endif
+// Bloques libres de más que un atajo debe dejar entre la cabeza y la cola
+// en el orden del ciclo. Entrar en el bloque de la cola mata y comer la
+// congela un tick, así que cada manzana comida siguiendo el ciclo gasta
+// uno; el margen cubre varias seguidas antes de que la cola avance.
+#ifndef AUTOPILOT_CYCLE_MARGIN
+#define AUTOPILOT_CYCLE_MARGIN  3
+#endif
+
+/*─── PARTIDA ──────────────────────────────────────────────────────────────*/
+// Serpientes y manzanas de cada partida. La serpiente 0 es la del jugador
+// (D-Pad o SW1); las demás son rivales con el control RIVAL_CONTROL.
+#ifndef SNAKE_COUNT
+#define SNAKE_COUNT     1
+#endif
+#ifndef APPLE_COUNT
+#define APPLE_COUNT     1
+#endif
+// Capacidad del mundo: los simuladores del host la suben para elegir
+// el número de serpientes y manzanas al ejecutar
+#ifndef MAX_SNAKES
+#define MAX_SNAKES      SNAKE_COUNT
+#endif
+#ifndef MAX_APPLES
+#define MAX_APPLES      APPLE_COUNT
+#endif
+#ifndef RIVAL_CONTROL
+#define RIVAL_CONTROL   CONTROL_AI
+#endif
+
+/*─── INSTANTÁNEAS ─────────────────────────────────────────────────────────*/
+// Ticks que guarda el anillo de rebobinado (una instantánea por tick)
+#ifndef REWIND_TICKS
+#define REWIND_TICKS    32
+#endif
+#if REWIND_TICKS < 1
+#error "REWIND_TICKS debe ser al menos 1"
+#endif
+
+/*─── PERFILADO ────────────────────────────────────────────────────────────*/
+// Con -DSNAKE_PROFILE se mide cada fase del bucle interior (ciclos y, en
+// RISC-V, instrucciones retiradas) y se vuelca un resumen en cada GAME OVER.
+// Sin la macro PROFILE_BEGIN/PROFILE_END no generan código.
+#define PROFILE_BUCKETS 33      // histograma log2: [0], [1], [2,4), ... [2^31,∞)
+#ifdef SNAKE_PROFILE
+#define PROFILE_BEGIN(phase) \
+    unsigned long long prof_c_##phase = readCycles(), prof_i_##phase = readInstret()
+#define PROFILE_END(phase) \
+    profileRecord(&profile, phase, readCycles() - prof_c_##phase, \
+                  readInstret() - prof_i_##phase)
+#define PROFILE_SPAN(phase, cycles) profileRecord(&profile, phase, cycles, 0)
+#else
+#define PROFILE_BEGIN(phase)
+#define PROFILE_END(phase)
+#define PROFILE_SPAN(phase, cycles)
+#endif
 
 /*─── CONFIGURACIÓN DE COLORES ──────────────────────────────────────────────*/
 #define APPLE_COLOR 0x00e100
 #define BLACK       0x000000
 #define SNAKE_COLOR 0xff0000
 #define ORANGE_COLOR 0xFF8000
+#define RIVAL_COLOR 0x0080ff
+#define HUD_COLOR   0xffffff
+#define WALL_COLOR  0x606060
+
+/*─── HUD ───────────────────────────────────────────────────────────────────*/
+// Franja inferior de la matriz reservada al marcador (longitud del jugador):
+// HUD_DIGITS dígitos de 3×5 LEDs separados por una columna, justo debajo
+// del tablero. HUD_HEIGHT 0 la desactiva.
+#ifndef HUD_HEIGHT
+#define HUD_HEIGHT      5
+#endif
+#ifndef HUD_DIGITS
+#define HUD_DIGITS      3
+#endif
+#define GLYPH_WIDTH     3
+#define GLYPH_HEIGHT    5
+#define GLYPH_BLANK     10              // glifo vacío (ceros a la izquierda)
+#if HUD_HEIGHT != 0 && (HUD_HEIGHT < GLYPH_HEIGHT || HUD_DIGITS * (GLYPH_WIDTH + 1) > LED_MATRIX_0_WIDTH)
+#error "El marcador no cabe en su franja"
+#endif
+
+/*─── TABLERO ───────────────────────────────────────────────────────────────*/
+// El tablero lógico trabaja en bloques de BLOCK_SIZE×BLOCK_SIZE LEDs y ocupa
+// la esquina superior izquierda de la matriz (BOARD_WIDTH×BOARD_HEIGHT LEDs),
+// por encima de la franja del marcador. Los tres se pueden cambiar con -D.
+// Por defecto el alto se recorta a un número par de bloques si el ancho
+// en bloques es impar: con los dos lados impares no hay ciclo hamiltoniano
+// y el piloto automático no puede llenar el tablero.
+#ifndef BLOCK_SIZE
+#define BLOCK_SIZE      2
+#endif
+#ifndef BOARD_WIDTH
+#define BOARD_WIDTH     LED_MATRIX_0_WIDTH
+#endif
+#ifndef BOARD_HEIGHT
+#if (BOARD_WIDTH / BLOCK_SIZE) % 2
+#define BOARD_HEIGHT    ((LED_MATRIX_0_HEIGHT - HUD_HEIGHT) / (2 * BLOCK_SIZE) * (2 * BLOCK_SIZE))
+#else
+#define BOARD_HEIGHT    (LED_MATRIX_0_HEIGHT - HUD_HEIGHT)
+#endif
+#endif
+#define BLOCK_COLS  (BOARD_WIDTH  / BLOCK_SIZE)
+#define BLOCK_ROWS  (BOARD_HEIGHT / BLOCK_SIZE)
+#define MAX_BLOCKS  (BLOCK_COLS * BLOCK_ROWS)
+// Resultado de un paso que se sale del tablero
+#define NO_BLOCK    (-1)
+
+#if BOARD_WIDTH > LED_MATRIX_0_WIDTH || BOARD_HEIGHT + HUD_HEIGHT > LED_MATRIX_0_HEIGHT
+#error "El tablero no cabe en la matriz LED (junto al marcador)"
+#endif
+#if BLOCK_COLS % 2 && BLOCK_ROWS % 2
+#warning "Tablero con los dos lados impares: el piloto automático no tiene ciclo hamiltoniano"
+#endif
+// Tablero toroidal: la serpiente sale por un borde y entra por el opuesto.
+// Solo cambia cómo se rellena stepTable, así que el tick cuesta lo mismo
+// con o sin bordes (initializeBoardTables también lo acepta en ejecución)
+#ifndef WRAP_EDGES
+#define WRAP_EDGES      0
+#endif
+#if MAX_BLOCKS > 32767
+#error "Demasiados bloques: los índices se guardan en 16 bits"
+#endif
+#if SNAKE_COUNT > MAX_SNAKES || APPLE_COUNT > MAX_APPLES
+#error "SNAKE_COUNT/APPLE_COUNT superan la capacidad del mundo"
+#endif
+#if MAX_SNAKES > BLOCK_COLS || MAX_SNAKES > 255
+#error "Demasiadas serpientes: cada una empieza en su propia columna"
+#endif
+
+/*─── NIVELES ───────────────────────────────────────────────────────────────*/
+// Nivel compilado con el que se juega (0 = sin muros; ver `levels`). En el
+// host, un fichero en RIPES_LEVEL tiene preferencia.
+#ifndef LEVEL
+#define LEVEL           0
+#endif
+#define LEVEL_COUNT     2
+#if LEVEL < 0 || LEVEL > LEVEL_COUNT
+#error "LEVEL no es un nivel compilado"
+#endif
+#define LEVEL_MAGIC     0x314C4E53u     // "SNL1" en little-endian
+#define LEVEL_HEADER    10              // magic, ancho, alto, tramos
+// Tramos que caben en un nivel leído de fichero: uno por bloque en el
+// peor caso (alternando libre y muro) y los de continuación
+#define LEVEL_MAX_RUNS  (MAX_BLOCKS + 2 * (MAX_BLOCKS / 255) + 2)
+#define LEVEL_BYTES     (LEVEL_HEADER + LEVEL_MAX_RUNS)
+
+// Marca de "sin cambio pendiente" en la etapa de render (no es un color válido)
+#define NO_COLOR    0xFFFFFFFFu
+// Bytes de un cuerpo empaquetado: 2 bits por segmento
+#define BODY_BYTES  ((MAX_BLOCKS + 3) / 4)
+// Bytes de los cuerpos de una instantánea: los de todos los anillos más
+// hasta tres bytes parciales por serpiente en los extremos y en el corte
+#define SNAP_BODY_BYTES (BODY_BYTES + 3 * MAX_SNAKES)
 
 /*─── ESTRUCTURAS Y ENUMERACIONES ───────────────────────────────────────────*/
 
-// Nodo que representa un segmento (bloque 2×2 LEDs) de la serpiente
-typedef struct node {
-    volatile unsigned int** leds;
-    struct node* next;
-} Node;
-
-// Serpiente con punteros a cabeza y cola para facilitar movimientos
+// Serpiente: bloques de cabeza y cola más la dirección de cada paso entre
+// segmentos (de la cola hacia la cabeza) en un anillo de 2 bits por paso.
+// Mover anota un paso en la cabeza y adelanta la cola siguiendo el suyo;
+// crecer solo anota. Sin reservar memoria y con un cuarto de byte por
+// segmento; el resto de bloques del cuerpo se deduce recorriendo los pasos.
 typedef struct snake {
-    Node* head;
-    Node* tail;
+    unsigned char  dirs[BODY_BYTES];    // anillo de length-1 pasos (motion)
+    int            first;               // posición en dirs del paso de la cola
+    unsigned short head;                // bloque de la cabeza
+    unsigned short tail;                // bloque de la cola
     int   length;
+    unsigned int color;                 // color de sus bloques
 } SnakeType;
 
-// Manzana representada como un bloque 2×2 LEDs
+// Manzana representada como un bloque de LEDs
 typedef struct apple {
-    volatile unsigned int** sections;
+    int block;                          // índice del bloque que ocupa
 } AppleType;
 
+// Contenido de cada bloque del tablero
+typedef enum { CELL_EMPTY, CELL_SNAKE, CELL_APPLE, CELL_WALL } CellType;
+
+// Nivel: muros fijos del tablero como mapa de bits comprimido por tramos
+// (RLE) en orden de bloque. Los tramos alternan libre y muro empezando por
+// libre, un byte cada uno; un 255 seguido de un 0 continúa el mismo tipo.
+// Lo que no cubren los tramos queda libre.
+typedef struct level {
+    unsigned short cols;                // dimensiones en bloques
+    unsigned short rows;
+    unsigned short count;               // tramos
+    const unsigned char* runs;
+} LevelType;
+
+// Rejilla de ocupación en RAM: el estado del juego se consulta aquí,
+// la matriz LED solo se escribe (nunca se lee de vuelta).
+typedef struct board {
+    volatile unsigned int* ledBase;
+    int           width;                // ancho de la matriz en LEDs (stride)
+    int           cols;                 // ancho del tablero en bloques
+    int           rows;                 // alto del tablero en bloques
+    const LevelType* level;             // muros que pone resetCells (o NULL)
+    const LevelType* paintedLevel;      // muros que muestra la matriz
+    unsigned char cells[MAX_BLOCKS];    // un CellType por bloque
+    // Conjunto de bloques libres: array denso con borrado por intercambio
+    // y mapa bloque → posición en el array, ambos mantenidos por setCell
+    unsigned short freeSlots[MAX_BLOCKS];
+    unsigned short slotOf[MAX_BLOCKS];
+    int           freeCount;
+    // Etapa de render: los cambios de color de un tick se acumulan aquí
+    // y se vuelcan juntos a la matriz LED al final del tick
+    unsigned int  shown[MAX_BLOCKS];    // color que muestra cada bloque
+    unsigned int  pending[MAX_BLOCKS];  // color pedido este tick o NO_COLOR
+    unsigned short dirty[MAX_BLOCKS];   // bloques con cambio pendiente
+    int           dirtyCount;
+    // Bloques que la matriz muestra encendidos (ni BLACK ni muro): array
+    // denso con borrado por intercambio, mantenido por renderFlush.
+    // Reiniciar apaga solo estos en lugar de toda la matriz; los muros
+    // se quedan pintados de una partida a otra.
+    unsigned short lit[MAX_BLOCKS];
+    unsigned short litSlot[MAX_BLOCKS];
+    int           litCount;
+    unsigned int  mmioWrites;           // escrituras MMIO del último volcado
+} BoardType;
+
+// Tablas precalculadas a partir de BLOCK_SIZE y las dimensiones, compartidas
+// por todos los tableros: bloque vecino en cada dirección (NO_BLOCK fuera del
+// tablero, o el del borde opuesto si es toroidal), que sirve a la vez para
+// mover la cabeza y para sondear el bloque frontal, y desplazamiento del LED
+// superior izquierdo de cada bloque
+static short        stepTable[4][MAX_BLOCKS];
+static unsigned int ledOffsetTable[MAX_BLOCKS];
+
+// Niveles compilados (LEVEL 1..LEVEL_COUNT), para el tablero por defecto
+// de 17×10 bloques: 1 = caja (muro en todo el borde), 2 = pilares y un
+// bloque central de 5×2
+static const unsigned char levelBoxRuns[] = {
+    0, 18, 15, 2, 15, 2, 15, 2, 15, 2, 15, 2, 15, 2, 15, 2, 15, 18
+};
+static const unsigned char levelPillarsRuns[] = {
+    38, 1, 3, 1, 3, 1, 27, 5, 12, 5, 27, 1, 3, 1, 3, 1
+};
+static const LevelType levels[LEVEL_COUNT] = {
+    { 17, 10, sizeof(levelBoxRuns),     levelBoxRuns     },
+    { 17, 10, sizeof(levelPillarsRuns), levelPillarsRuns },
+};
+
+// Instantánea del mundo: todo lo que hace falta para seguir la partida
+// desde un tick. De cada cuerpo se copian tal cual los bytes de su anillo
+// que contienen pasos, uno tras otro; como las serpientes no se solapan,
+// siempre caben en SNAP_BODY_BYTES.
+typedef struct snapshot {
+    unsigned int   tick;
+    unsigned int   rng;
+    unsigned int   scriptRng[MAX_SNAKES];
+    unsigned short head[MAX_SNAKES];
+    unsigned short length[MAX_SNAKES];
+    unsigned short first[MAX_SNAKES];         // posición del paso de la cola
+    unsigned char  dir[MAX_SNAKES];           // motion (bits 0-1) y viva (bit 2)
+    short          apples[MAX_APPLES];
+    unsigned char  body[SNAP_BODY_BYTES];
+} SnapshotType;
+
+// Anillo con las instantáneas de los últimos REWIND_TICKS ticks
+typedef struct rewind {
+    SnapshotType   ring[REWIND_TICKS];
+    int            next;                      // siguiente posición a escribir
+    int            count;                     // instantáneas guardadas
+} RewindType;
+
+// Resultado de avanzar la partida un tick: STEP_DEAD cuando no queda
+// ninguna serpiente viva, STEP_WON cuando no caben más manzanas
+typedef enum { STEP_MOVED, STEP_ATE, STEP_DEAD, STEP_WON } StepResult;
+
+// Planificador de paso fijo de una tarea periódica: le toca cada `period`
+// ciclos, descontando lo que haya tardado el bucle en atenderla
+typedef struct scheduler {
+    unsigned long long period;          // periodo del tick en ciclos
+    unsigned long long deadline;        // instante de inicio del próximo tick
+    unsigned long long late;            // retraso con que arrancó el último
+    unsigned int       ticks;           // ticks ejecutados
+    unsigned int       overruns;        // ticks que perdieron un periodo entero
+} SchedulerType;
+
+// Marcador: glifo que muestra cada dígito, para redibujar solo los que
+// cambian y, dentro de cada uno, solo las filas que cambian
+typedef struct hud {
+    volatile unsigned int* base;        // LED superior izquierdo del primer dígito
+    int            width;               // ancho de la matriz en LEDs (stride)
+    unsigned int   value;               // valor mostrado
+    unsigned char  glyph[HUD_DIGITS];   // glifo mostrado en cada dígito
+    unsigned int   mmioWrites;          // escrituras MMIO de la última actualización
+} HudType;
+
+// Estados del bucle principal
+typedef enum { STATE_PLAYING, STATE_GAME_OVER, STATE_RESTARTING } GameState;
+
 // Posibles direcciones de movimiento
 typedef enum { RIGHT, LEFT, UP, DOWN } motion;
 
-// Tipos de colisiones detectables
-typedef enum { COLLISION_NONE, COLLISION_SELF, COLLISION_APPLE } CollisionType;
-
+// Entrada del D-Pad muestreada de forma continua. Cada flanco de pulsación
+// encola un giro; en cada tick se aplica como mucho uno.
+typedef struct input {
+    volatile unsigned int* pads[4];     // registro de cada dirección (por motion)
+    unsigned int  prev;                 // botones pulsados en la última muestra
+    unsigned char queue[TURN_QUEUE_LEN];// giros pendientes (cola circular)
+    int           first;                // posición del primer giro
+    int           count;                // giros encolados
+    motion        lastDir;              // dirección tras aplicar toda la cola
+    unsigned int  mmioReads;            // lecturas MMIO acumuladas
+} InputType;
+
+// Grabación de una partida: semilla, dimensiones de la matriz, muros del
+// nivel, si los bordes son toroidales y una dirección de 2 bits por tick,
+// comprimida por tramos (RLE).
+// Cada tramo ocupa 16 bits: dirección en los 2 altos y repeticiones en los
+// 14 bajos. La misma estructura sirve para reproducir (cursor de lectura).
+typedef struct recording {
+    unsigned int   seed;
+    unsigned int   level;               // levelChecksum de los muros
+    unsigned short cols;                // ancho del tablero en bloques
+    unsigned short rows;                // alto del tablero en bloques
+    unsigned short wrap;                // 1 si el tablero es toroidal
+    unsigned short runs[RECORD_MAX_RUNS];
+    int            count;               // tramos usados
+    unsigned int   ticks;               // ticks grabados
+    int            overflow;            // 1 si se agotó el espacio
+    int            cursor;              // tramo en reproducción
+    unsigned int   cursorLeft;          // ticks que quedan en ese tramo
+    int            rewound;             // 1 si la partida se rebobinó
+} RecordingType;
+
+// Piloto automático: tablas precalculadas del tablero y búferes de
+// búsqueda reutilizables, de modo que decidir un tick no reserva memoria
+typedef struct autopilot {
+    int            cells;
+    int            hasCycle;                  // 1 si el tablero admite ciclo hamiltoniano
+    unsigned short cycleOrder[MAX_BLOCKS];    // posición de cada bloque en el ciclo
+    unsigned char  cycleDir[MAX_BLOCKS];      // dirección hacia el siguiente del ciclo
+    unsigned short queue[MAX_BLOCKS];         // cola de la búsqueda en anchura
+    short          parent[MAX_BLOCKS];        // bloque desde el que se llegó
+    unsigned short path[MAX_BLOCKS];          // último camino encontrado
+    unsigned int   seen[MAX_BLOCKS];          // marca de visita (== stamp)
+    unsigned int   blocked[MAX_BLOCKS];       // ocupación simulada (== stamp)
+    unsigned int   stamp;                     // evita limpiar los arrays
+    unsigned long long deadline;              // fin del presupuesto del tick
+    unsigned int   overBudget;                // búsquedas cortadas por presupuesto
+} AutopilotType;
+
+// Tipos de colisiones detectables (SELF: cualquier serpiente, propia o rival)
+typedef enum { COLLISION_NONE, COLLISION_SELF, COLLISION_APPLE, COLLISION_WALL } CollisionType;
+
+// Origen de la dirección de cada serpiente
+typedef enum { CONTROL_DPAD, CONTROL_SCRIPT, CONTROL_AI } ControlType;
+
+// Destino de una serpiente en el tick en curso
+typedef enum { FATE_MOVE, FATE_EAT, FATE_DIE } FateType;
+
+// Mundo de la partida: K serpientes y M manzanas sobre un tablero compartido.
+// Cada tick se decide primero el destino de todas las serpientes vivas con
+// el estado del tick anterior (movimiento simultáneo) y después se aplican
+// en orden de índice, así que el resultado es determinista. El coste de un
+// tick es O(K) más los bloques que cambian, no K veces el tablero.
+typedef struct world {
+    BoardType*     board;
+    int            snakeCount;
+    int            appleCount;
+    int            liveCount;                 // serpientes vivas
+    SnakeType      snakes[MAX_SNAKES];
+    unsigned char  alive[MAX_SNAKES];
+    unsigned char  control[MAX_SNAKES];       // ControlType
+    unsigned char  dir[MAX_SNAKES];           // motion de este tick
+    unsigned char  fate[MAX_SNAKES];          // FateType de este tick
+    short          front[MAX_SNAKES];         // bloque frontal de este tick
+    unsigned int   scriptRng[MAX_SNAKES];     // generador de cada guion
+    AppleType      apples[MAX_APPLES];
+    unsigned int   rng;                       // generador de las manzanas
+    unsigned int   ticks;                     // ticks jugados
+    // Reserva de bloques frontales: claim[b] == stamp si una serpiente
+    // entra en b este tick y claimer[b] dice cuál (choque cabeza-cabeza)
+    unsigned int   claim[MAX_BLOCKS];
+    unsigned char  claimer[MAX_BLOCKS];
+    unsigned int   stamp;
+} WorldType;
+
+// Fases del bucle interior que mide el perfilado
+typedef enum {
+    PHASE_INPUT,        // lectura de la dirección (D-Pad, grabación o piloto)
+    PHASE_BOUNDS,       // paso de la cabeza y comprobación de borde
+    PHASE_PROBE,        // consulta del bloque frontal en la rejilla
+    PHASE_MOVE,         // motionSnake / growSnake
+    PHASE_APPLE,        // updateApple
+    PHASE_RENDER,       // renderFlush
+    PHASE_LATENCY,      // retraso del arranque del tick sobre su plazo
+    PHASE_COUNT
+} PhaseType;
+
+#ifdef SNAKE_PROFILE
+// Estadísticas de una fase: extremos, suma para la media e histograma
+// log2 de la duración en ciclos
+typedef struct phaseStats {
+    unsigned int       count;
+    unsigned long long minCycles, maxCycles, sumCycles;
+    unsigned long long sumInstret;
+    unsigned int       histogram[PROFILE_BUCKETS];
+} PhaseStats;
+
+typedef struct profile {
+    PhaseStats phase[PHASE_COUNT];
+} ProfileType;
+
+// Un solo perfil global: el bucle interior es de un solo hilo
+static ProfileType profile;
+#endif
+
+
+/*─── ESTADO DEL JUEGO ──────────────────────────────────────────────────────*/
+// Todo el estado de la partida vive en un único bloque estático de tamaño
+// fijo: nada se reserva ni se libera al empezar o acabar una partida, así
+// que cientos de reinicios no hacen crecer ni fragmentar nada. Reiniciar
+// solo reescribe este bloque (resetBoard, resetWorld...).
+typedef struct arena {
+    BoardType      board;
+    LevelType      level;               // nivel leído del host
+    WorldType      world;
+    InputType      input;
+    SchedulerType  sched;               // tick de juego
+    SchedulerType  blink;               // parpadeo de GAME OVER
+    RecordingType  record;              // partida en curso
+    RecordingType  replay;              // partida a reproducir
+    AutopilotType  autopilot;
+    RewindType     history;
+#if HUD_HEIGHT
+    HudType        hud;
+#endif
+} ArenaType;
+
+// RAM del juego en el peor caso: el bloque de estado, las tablas
+// compartidas y los búferes estáticos de serialización (grabaciones y
+// nivel). Es fija; solo la pila de llamadas queda fuera.
+#ifdef SNAKE_PROFILE
+#define PROFILE_BYTES   sizeof(ProfileType)
+#else
+#define PROFILE_BYTES   0
+#endif
+#define GAME_FOOTPRINT  (sizeof(ArenaType) + sizeof(stepTable) + sizeof(ledOffsetTable) + \
+                         RECORD_BYTES + LEVEL_BYTES + PROFILE_BYTES)
+#ifndef RAM_BUDGET
+#define RAM_BUDGET      (128 * 1024)    // RAM de datos disponible para el juego
+#endif
+_Static_assert(GAME_FOOTPRINT <= RAM_BUDGET, "El estado del juego no cabe en RAM_BUDGET");
+
+// El juego no usa memoria dinámica: cualquier llamada nueva no compila.
+// (Las herramientas del host que incluyen el motor sí pueden usarla.)
+#if defined(__GNUC__) && !defined(SNAKE_NO_MAIN)
+#pragma GCC poison malloc calloc realloc free
+#endif
+
+
+/*─── FUNCIONES: TABLERO ──────────────────────────────────────────────────────*/
+
+                // Precalcula las tablas de pasos compartidas (una vez)
+void            initializeBoardTables(int wrap);
+                // Asocia el tablero a la matriz LED (NULL = sin pantalla)
+void            initializeBoard(BoardType* board, volatile unsigned int* ledBase);
+                // Vacía la rejilla de ocupación al empezar cada partida
+void            resetBoard(BoardType* board);
+                // Vacía solo la rejilla y el conjunto libre (no el render)
+void            resetCells(BoardType* board);
+                // Cambia el contenido de un bloque manteniendo el conjunto libre
+void            setCell(BoardType* board, int block, CellType type);
+                // Devuelve el LED superior izquierdo de un bloque
+volatile unsigned int* blockLed(BoardType* board, int block);
+                // Encola el cambio de color de un bloque para este tick
+void            paintBlock(BoardType* board, int block, unsigned int color);
+                // Vuelca los cambios del tick a la matriz LED en orden de dirección
+unsigned int    renderFlush(BoardType* board);
+                // Apaga un tramo de los bloques encendidos (devuelve los que quedan)
+int             clearTouched(BoardType* board, int budget);
+
+/*─── FUNCIONES: NIVELES ──────────────────────────────────────────────────────*/
+
+                // Fija los muros de las próximas partidas (NULL = sin muros)
+int             setLevel(BoardType* board, const LevelType* level);
+                // Suma de comprobación de los muros del nivel (0 sin muros)
+unsigned int    levelChecksum(const LevelType* level);
+                // Interpreta un nivel serializado (tramos dentro de `in`)
+int             decodeLevel(LevelType* level, const unsigned char* in, int len);
+                // Pide al host un nivel desde fichero
+int             loadLevel(LevelType* level);
 
 /*─── FUNCIONES: MANZANA ──────────────────────────────────────────────────────*/
 
-                // Inicializa la estructura de la manzana
-AppleType*      initializeApple(volatile unsigned int* ledBase, int width);
-                // Genera una nueva posición aleatoria para la manzana
-int             generateApplePosition(AppleType* apple, volatile unsigned int* ledBase, int width, int height, int seed);
-                // Actualiza posición y LEDs de la manzana tras ser comida
-void            updateApple(AppleType* apple, volatile unsigned int* ledBase, int width, int height, int* seed);
+                // Elige un bloque libre al azar para la manzana
+int             generateApplePosition(AppleType* apple, BoardType* board, unsigned int* rng);
+                // Actualiza posición y LEDs de la manzana (0 si el tablero está lleno)
+int             updateApple(AppleType* apple, BoardType* board, unsigned int* rng);
 
 /*─── FUNCIONES: SNAKE ────────────────────────────────────────────────────────*/
 
-                // Inicializa la serpiente en la posición inicial (0,0)
-SnakeType*      initializeSnake(volatile unsigned int* ledBase, int width);
-                // Mueve la serpiente reutilizando el último nodo (cola) como nueva cabeza
-void            motionSnake(SnakeType* snake, motion currentDir, int width);
-                // Crece la serpiente creando un nuevo nodo frontal
-void            growSnake(SnakeType* snake, motion currentDir, int width);
-                // Detecta colisiones según el color de los LEDs frontales de la cabeza
-CollisionType   checkCollisionByColor(volatile unsigned int* headLeds[2]);
+                // Coloca una serpiente de un bloque en `block`
+void            startSnake(SnakeType* snake, BoardType* board, int block, unsigned int color);
+                // Mueve la serpiente avanzando cabeza y cola en el buffer circular
+void            motionSnake(SnakeType* snake, BoardType* board, motion currentDir);
+                // Crece la serpiente añadiendo un bloque frontal
+void            growSnake(SnakeType* snake, BoardType* board, motion currentDir);
+                // Detecta colisiones consultando la rejilla de ocupación
+CollisionType   checkCollision(BoardType* board, int block);
+
+/*─── FUNCIONES: MUNDO ────────────────────────────────────────────────────────*/
+
+                // Vacía la reserva de bloques frontales (una vez, al arrancar)
+void            initializeWorld(WorldType* w);
+                // Empieza una partida con `snakes` serpientes y `apples` manzanas
+void            resetWorld(WorldType* w, BoardType* board, int snakes, int apples,
+                           unsigned int seed);
+                // Elige la dirección de las serpientes guionizadas y automáticas
+void            steerSnakes(WorldType* w, AutopilotType* ai);
+                // Jugador guionizado: recto con giros al azar, evitando chocar
+motion          scriptDirection(BoardType* board, SnakeType* snake, unsigned int* rng,
+                                motion dir);
+                // Avanza todas las serpientes un tick con sus w->dir
+StepResult      stepWorld(WorldType* w);
+
+/*─── FUNCIONES: INSTANTÁNEAS ─────────────────────────────────────────────────*/
+
+                // Guarda el estado del mundo en una instantánea
+void            takeSnapshot(WorldType* w, SnapshotType* snap);
+                // Devuelve el mundo (rejilla y pantalla incluidas) a una instantánea
+void            restoreSnapshot(WorldType* w, const SnapshotType* snap);
+                // Vacía el anillo de rebobinado
+void            resetRewind(RewindType* rw);
+                // Guarda la instantánea del tick en curso en el anillo
+void            rewindPush(RewindType* rw, WorldType* w);
+                // Vuelve hasta `ticks` ticks atrás (devuelve los rebobinados)
+int             rewindBack(RewindType* rw, WorldType* w, int ticks);
+
+/*─── FUNCIONES: TEMPORIZACIÓN ────────────────────────────────────────────────*/
+
+                // Lee el contador de ciclos (rdcycle) o el reloj del host
+unsigned long long readCycles(void);
+                // Arranca el planificador con un periodo en microsegundos
+void            initializeScheduler(SchedulerType* sched, unsigned int periodUs);
+                // Dice, sin esperar, si ya toca el siguiente tick (y lo adelanta)
+int             tickDue(SchedulerType* sched, unsigned long long now);
+
+/*─── FUNCIONES: PERFILADO ────────────────────────────────────────────────────*/
+#ifdef SNAKE_PROFILE
+                // Lee el contador de instrucciones retiradas (0 en el host)
+unsigned long long readInstret(void);
+                // Vacía las estadísticas al empezar cada partida
+void            profileReset(ProfileType* prof);
+                // Acumula una medida de una fase
+void            profileRecord(ProfileType* prof, PhaseType phase,
+                              unsigned long long cycles, unsigned long long instret);
+                // Imprime el resumen por fase y sus histogramas
+void            profileDump(ProfileType* prof);
+#endif
+
+/*─── FUNCIONES: ENTRADA ──────────────────────────────────────────────────────*/
+
+                // Asocia los registros del D-Pad y vacía el estado
+void            initializeInput(InputType* input);
+                // Vacía la cola de giros al empezar una partida
+void            resetInput(InputType* input, motion currentDir);
+                // Lee el D-Pad y encola los giros de las nuevas pulsaciones
+void            sampleInput(InputType* input);
+                // Saca el siguiente giro de la cola (o mantiene la dirección)
+motion          nextDirection(InputType* input, motion currentDir);
+
+/*─── FUNCIONES: GRABACIÓN ────────────────────────────────────────────────────*/
+
+                // Empieza una grabación vacía para una partida
+void            startRecording(RecordingType* rec, unsigned int seed, int cols, int rows,
+                               unsigned int level, int wrap);
+                // Añade la dirección de un tick a la grabación
+void            recordDirection(RecordingType* rec, motion dir);
+                // Devuelve la dirección del siguiente tick grabado (-1 al terminar)
+int             nextReplayDirection(RecordingType* rec);
+                // Serializa la grabación en formato binario compacto
+int             encodeRecording(RecordingType* rec, unsigned char* out);
+                // Carga una grabación serializada (0 si no es válida)
+int             decodeRecording(RecordingType* rec, const unsigned char* in, int len);
+                // Guarda la grabación en el host (si lo hay)
+void            saveRecording(RecordingType* rec);
+                // Carga del host una grabación para reproducir (0 si no hay)
+int             loadRecording(RecordingType* rec, int cols, int rows, unsigned int level,
+                              int wrap);
+                // Suma de comprobación FNV-1a de la rejilla de ocupación
+unsigned int    boardChecksum(BoardType* board);
+
+/*─── FUNCIONES: PILOTO AUTOMÁTICO ────────────────────────────────────────────*/
+
+                // Precalcula vecinos y ciclo hamiltoniano del tablero
+void            initializeAutopilot(AutopilotType* ai, BoardType* board);
+                // Elige la dirección del tick en lugar del D-Pad
+motion          autopilotDirection(AutopilotType* ai, BoardType* board, SnakeType* snake,
+                                   AppleType* apple, motion currentDir);
+                // Búsqueda en anchura de `from` a `target` (longitud, 0 o -1)
+int             autopilotSearch(AutopilotType* ai, BoardType* board, int from, int target,
+                                unsigned int blockedStamp);
+
+/*─── FUNCIONES: HUD ──────────────────────────────────────────────────────────*/
+
+                // Asocia el marcador a su franja (que debe estar apagada)
+void            initializeHud(HudType* hud, volatile unsigned int* ledBase, int width);
+                // Muestra `value` redibujando solo las filas de glifo que cambian
+unsigned int    updateHud(HudType* hud, unsigned int value);
 
 /*─── FUNCIONES: UTILIDADES ────────────────────────────────────────────────────*/
-            // Genera una posición aleatoria en la matriz LED
-int         randomPosition(int width, int height, int seed);
-            // Pinta un conjunto de LEDs con el color indicado
-void        paintLEDs(volatile unsigned int* leds[], int count, unsigned int color);
+            // Siembra el generador pseudoaleatorio (una vez por partida)
+void        initializeRandom(unsigned int* rng, unsigned int seed);
+            // Devuelve el siguiente número pseudoaleatorio (xorshift32)
+unsigned int nextRandom(unsigned int* rng);
             // Limpia toda la pantalla (matriz LED)
 void        limpiarPantalla(volatile unsigned int* ledBase, int width, int height);
-            // Verifica si un bloque 2×2 LEDs está libre (sin color)
-int         isFreeZone(volatile unsigned int* ledBase, int pos, int width);
-
-
-int         checkBoundary(int headX, int headY, int width, int height);
-            // Crea un nodo nuevo dado una base LED (superior izquierda)
-Node*       createNode(volatile unsigned int* blockBase, int width);
-            // Espera un retardo en milisegundos
-void        delay_ms(int ms);
-            // Libera la memoria dinámica de la serpiente
-void        freeSnake(SnakeType* snake);
-// Calcula nueva base frontal de la serpiente según dirección
-volatile unsigned int* computeNewHeadBase(volatile unsigned int* oldHeadLed, motion currentDir, int width);
 
 
 /*─── FUNCIÓN PRINCIPAL ─────────────────────────────────────────────────────*/
+// Los simuladores del host (host/batch.c) incluyen este fichero con
+// SNAKE_NO_MAIN para reutilizar el motor con su propio main.
+#ifndef SNAKE_NO_MAIN
 /**
  * main:
- *   Punto de entrada del juego. Se encarga de inicializar la matriz LED,
- *   el D-Pad, la manzana y la serpiente, y contiene dos bucles:
- *   - Uno exterior que permite reiniciar la partida al pulsar switch 0.
- *   - Uno interior que ejecuta el juego hasta GAME OVER.
+ *   Punto de entrada del juego. Inicializa la matriz LED, el D-Pad y el
+ *   mundo (serpientes y manzanas) y ejecuta un bucle cooperativo que no
+ *   se bloquea nunca: en cada vuelta reparte el tiempo entre tareas
+ *   cortas (muestrear la entrada, la tarea del estado actual y volcar el
+ *   render) y las que no tienen trabajo ceden la vuelta. Estados:
+ *   - PLAYING:    un tick de juego cada TICK_PERIOD_US hasta GAME OVER.
+ *   - GAME_OVER:  parpadeo del LED de la esquina hasta pulsar switch 0
+ *                 (o switch 2, que rebobina y sigue la misma partida).
+ *   - RESTARTING: apaga por tramos solo los bloques que encendió la
+ *                 partida anterior y empieza la siguiente.
  */
 int main() {
     // 1) Configurar punteros a la matriz LED y sus dimensiones
@@ -96,179 +716,571 @@ int main() {
     int width  = LED_MATRIX_0_WIDTH;
     int height = LED_MATRIX_0_HEIGHT;
 
-    // 2) Configurar punteros al D-Pad y al switch 0
-    volatile unsigned int * d_pad_up = D_PAD_0_UP;
-    volatile unsigned int * d_pad_do = D_PAD_0_DOWN;
-    volatile unsigned int * d_pad_le = D_PAD_0_LEFT;
-    volatile unsigned int * d_pad_ri = D_PAD_0_RIGHT;
+    // Todo el estado del juego, en un bloque estático (ver ArenaType)
+    static ArenaType arena;
+    BoardType*     board     = &arena.board;
+    WorldType*     world     = &arena.world;
+    InputType*     input     = &arena.input;
+    SchedulerType* sched     = &arena.sched;
+    SchedulerType* blink     = &arena.blink;
+    RecordingType* record    = &arena.record;
+    RecordingType* replay    = &arena.replay;
+    AutopilotType* autopilot = &arena.autopilot;
+    RewindType*    history   = &arena.history;
+
+    // 2) Configurar la entrada del D-Pad y el puntero al switch 0
+    initializeInput(input);
     volatile unsigned int * switch_base = SWITCHES_0_BASE;
 
-    // Bucle exterior: reinicia la partida cada vez que se pulsa switch0
+    // Rejilla de ocupación del tablero (estado lógico de la partida). La
+    // matriz entera solo se limpia al arrancar; después cada reinicio
+    // apaga únicamente lo que se encendió
+    limpiarPantalla(ledBase, width, height);
+    initializeBoardTables(WRAP_EDGES);
+    initializeBoard(board, ledBase);
+    initializeWorld(world);
+    // Muros: el nivel que aporte el host o, si no, el compilado
+    if (loadLevel(&arena.level)) setLevel(board, &arena.level);
+    else if (LEVEL)              setLevel(board, &levels[LEVEL - 1]);
+    // El jugador es la serpiente 0 del mundo
+    SnakeType* player = &world->snakes[0];
+    // Planificadores de las tareas periódicas: tick de juego y parpadeo
+    initializeScheduler(sched, TICK_PERIOD_US);
+    initializeScheduler(blink, BLINK_PERIOD_US);
+    // Si el host aporta una grabación, se reproduce en lugar de leer el D-Pad
+    int replaying = loadRecording(replay, board->cols, board->rows,
+                                  levelChecksum(board->level), WRAP_EDGES);
+    // Piloto automático (SW1): sus tablas solo dependen del tamaño
+    initializeAutopilot(autopilot, board);
+    // Marcador con la longitud del jugador en la franja inferior
+#if HUD_HEIGHT
+    initializeHud(&arena.hud, ledBase, width);
+#endif
+
+    // Estado del bucle; se arranca reiniciando sobre un tablero vacío
+    GameState    state      = STATE_RESTARTING;
+    motion       currentDir = DOWN;
+    int          won        = 0;
+    unsigned int blinkOn    = 0;
+    volatile unsigned int* corner_led = ledBase;  // puntero a LED [0,0]
+
+    // Bucle cooperativo: ninguna tarea espera a que le toque
     while (1) {
-        // 3) Limpiar toda la pantalla antes de cada partida
-        limpiarPantalla(ledBase, width, height);
-
-        // 4) Inicializar los objetos del juego
-        AppleType*  apple = initializeApple(ledBase, width);
-        SnakeType*  snake = initializeSnake(ledBase, width);
-
-         // 5) Colocar la primera manzana en posición aleatoria
-        int pos = 60;  // semilla inicial
-        pos = generateApplePosition(apple, ledBase, width, height, pos);
-        paintLEDs(apple->sections, 4, APPLE_COLOR);
-
-        // 6) Definir la dirección inicial de la serpiente
-        motion currentDir = DOWN;
-
-        // Variables auxiliares para coordenadas de cabeza
-        int index, headX, headY;
-        volatile unsigned int* oldHeadLed;
-
-        // Bucle interior de juego: se repetirá hasta GAME OVER
-        while (1) {
-            // 7.1) Leer D-Pad y actualizar currentDir (no permite 180°)
-            if      (*d_pad_up == 1    && currentDir != DOWN)  currentDir = UP;
-            else if (*d_pad_do == 1    && currentDir != UP)    currentDir = DOWN;
-            else if (*d_pad_le == 1    && currentDir != RIGHT) currentDir = LEFT;
-            else if (*d_pad_ri == 1    && currentDir != LEFT)  currentDir = RIGHT;
-
-            // 7.2) Obtener la posición actual de la cabeza en coordenadas (x,y)
-            oldHeadLed = snake->head->leds[0];
-            index      = oldHeadLed - ledBase;   // índice lineal
-            headX      = index %  width;         // columna
-            headY      = index /  width;         // fila
-
-            // 7.3) Simular el siguiente paso en (newX,newY)
-            int newX = headX, newY = headY;
-            switch (currentDir) {
-                case UP:    newY--; break;
-                case DOWN:  newY++; break;
-                case LEFT:  newX--; break;
-                case RIGHT: newX+=2; break;
+        unsigned long long now = readCycles();
+
+        // 3) Tarea de entrada: el D-Pad se muestrea en cada vuelta para
+        //    no perder pulsaciones cortas entre ticks
+        if (state == STATE_PLAYING && !replaying) sampleInput(input);
+
+        switch (state) {
+        // 4) Tarea de juego: un tick por periodo hasta GAME OVER
+        case STATE_PLAYING: {
+            if (!tickDue(sched, now)) break;
+            RIPES_HOST_TICK();
+            PROFILE_SPAN(PHASE_LATENCY, sched->late);
+            rewindPush(history, world);
+
+            // 4.1) Aplicar un giro de la cola (ya filtrado contra giros de
+            //      180°). Al reproducir, la dirección sale de la grabación.
+            //      Con SW1 activo decide el piloto automático.
+            PROFILE_BEGIN(PHASE_INPUT);
+            int replayDir = replaying ? nextReplayDirection(replay) : 0;
+            if (replaying) {
+                if (replayDir >= 0) currentDir = (motion)replayDir;
             }
-
-            // 7.4) Detectar colisión con el borde antes de mover
-            if (checkBoundary(newX, newY, width, height)) {
-                break;  // GAME OVER por salirse de la matriz
+            else if (*switch_base & SW1) {
+                currentDir = autopilotDirection(autopilot, board, player, &world->apples[0],
+                                                currentDir);
+                resetInput(input, currentDir);
             }
-
-            // 7.5) Detectar choque inminente leyendo solo 2 LEDs frontales
-            volatile unsigned int* headFront[2];
-            switch (currentDir) {
-                case UP:
-                    headFront[0] = oldHeadLed - width;
-                    headFront[1] = oldHeadLed - width + 1;
-                    break;
-                case DOWN:
-                    headFront[0] = oldHeadLed + 2*width;
-                    headFront[1] = oldHeadLed + 2*width + 1;
-                    break;
-                case LEFT:
-                    headFront[0] = oldHeadLed - 1;
-                    headFront[1] = oldHeadLed - 1 + width;
-                    break;
-                default:  // RIGHT
-                    headFront[0] = oldHeadLed + 2;
-                    headFront[1] = oldHeadLed + 2 + width;
-                    break;
+            else {
+                sampleInput(input);
+                currentDir = nextDirection(input, currentDir);
+            }
+            if (replayDir >= 0) {
+                recordDirection(record, currentDir);
+                world->dir[0] = (unsigned char)currentDir;
+                steerSnakes(world, autopilot);
+            }
+            PROFILE_END(PHASE_INPUT);
+
+            // 4.2) Avanzar la partida un tick: sondeo de los bloques frontales,
+            //      colisiones, movimiento o crecimiento y nuevas manzanas.
+            //      Al acabarse la grabación se acaba la partida.
+            StepResult result = replayDir >= 0 ? stepWorld(world) : STEP_DEAD;
+            won = result == STEP_WON;
+            if (!won && result != STEP_DEAD && world->alive[0]) break;
+
+            // 4.3) GAME OVER (el jugador se sale o choca) o VICTORIA (no
+            //      caben más manzanas): resumen de la partida y grabación
+            renderFlush(board);
+            printf("%s: longitud=%d ticks=%u retrasos=%u\n",
+                   won ? "VICTORIA" : "GAME OVER", player->length, record->ticks, sched->overruns);
+#ifdef SNAKE_PROFILE
+            profileDump(&profile);
+#endif
+            saveRecording(record);
+
+            // Una reproducción termina en su GAME OVER con el resumen de la partida
+            if (replaying) {
+                printf("REPLAY: longitud=%d ticks=%u checksum=%08x\n",
+                       player->length, record->ticks, boardChecksum(board));
+                return 0;
             }
+            blinkOn = 0;
+            initializeScheduler(blink, BLINK_PERIOD_US);
+            state = STATE_GAME_OVER;
+            break;
+        }
 
-            // 7.6) Evaluar tipo de colisión y actuar en consecuencia
-            CollisionType col = checkCollisionByColor(headFront);
-            if (col == COLLISION_SELF) {
-                break;  // GAME OVER al chocar contra sí misma
+        // 5) Tarea de parpadeo: alterna el LED de la esquina (naranja si se
+        //    ha perdido, color manzana si se ha llenado el tablero) hasta
+        //    que se pulsa SW0 (nueva partida) o SW2 (rebobinar)
+        case STATE_GAME_OVER:
+            if (*switch_base & SW0) {
+                *corner_led = board->shown[0];     // el LED vuelve a su bloque
+                state = STATE_RESTARTING;
+                break;
             }
-            else if (col == COLLISION_APPLE) {
-                // Crece y reposiciona la manzana
-                updateApple(apple, ledBase, width, height, &pos);
-                growSnake(snake, currentDir, width);
+            // 5.1) Rebobinar: la partida sigue REWIND_TICKS ticks antes del
+            //      final. Las manzanas que salgan ya no dependen solo de la
+            //      semilla, así que la grabación deja de ser reproducible
+            if ((*switch_base & SW2) && rewindBack(history, world, REWIND_TICKS)) {
+                *corner_led = board->shown[0];
+                currentDir = (motion)world->dir[0];
+                resetInput(input, currentDir);
+                record->rewound = 1;
+                initializeScheduler(sched, TICK_PERIOD_US);
+                state = STATE_PLAYING;
+                break;
             }
-            else {
-                // Movimiento normal (sin crecer)
-                motionSnake(snake, currentDir, width);
+            if (!tickDue(blink, now)) break;
+            RIPES_HOST_TICK();
+            blinkOn ^= 1;
+            *corner_led = blinkOn ? (won ? APPLE_COLOR : ORANGE_COLOR) : board->shown[0];
+            break;
+
+        // 6) Tarea de reinicio: apaga RESTART_SLICE bloques por vuelta y,
+        //    cuando no queda ninguno encendido, empieza la partida
+        case STATE_RESTARTING:
+            if (clearTouched(board, RESTART_SLICE) > 0) break;
+            // La rejilla se rehace entera (solo RAM) para que el conjunto
+            // libre, y con él las manzanas, dependan solo de la semilla
+            resetBoard(board);
+
+            // 6.1) Sembrar la partida (con la semilla grabada si se reproduce)
+            //      y colocar serpientes y manzanas. La grabación solo guarda
+            //      la dirección del jugador: con rivales automáticos la
+            //      reproducción es exacta solo si su presupuesto no se agota
+            //      (o son guionizados)
+            unsigned int seed = replaying ? replay->seed : GAME_SEED;
+            startRecording(record, seed, board->cols, board->rows,
+                           levelChecksum(board->level), WRAP_EDGES);
+            resetWorld(world, board, SNAKE_COUNT, APPLE_COUNT, seed);
+            resetRewind(history);
+            won = 0;
+#ifdef SNAKE_PROFILE
+            profileReset(&profile);
+#endif
+
+            // 6.2) Dirección inicial del jugador; al reproducir no se
+            //      espera entre ticks
+            currentDir = DOWN;
+            resetInput(input, currentDir);
+            initializeScheduler(sched, replaying ? 0 : TICK_PERIOD_US);
+            state = STATE_PLAYING;
+            break;
+        }
+
+        // 7) Tarea de render: vuelca a la matriz lo que hayan cambiado las
+        //    tareas de esta vuelta, solo los bloques que cambian. El
+        //    marcador va aparte porque el final de partida ya vuelca el
+        //    tablero; sin cambio de longitud no escribe nada
+        if (board->dirtyCount) {
+            PROFILE_BEGIN(PHASE_RENDER);
+            renderFlush(board);
+            PROFILE_END(PHASE_RENDER);
+        }
+#if HUD_HEIGHT
+        updateHud(&arena.hud, (unsigned int)player->length);
+#endif
+    }
+
+    return 0;
+}
+#endif /* SNAKE_NO_MAIN */
+
+
+/*─── IMPLEMENTACIONES: TABLERO ──────────────────────────────────────────────*/
+
+/**
+ * initializeBoardTables:
+ *   Precalcula, a partir de BLOCK_SIZE y de las dimensiones, las tablas
+ *   que usan los caminos calientes: el bloque vecino en cada dirección
+ *   (NO_BLOCK si se sale del tablero) y el desplazamiento del LED
+ *   superior izquierdo de cada bloque. Son las mismas para todos los
+ *   tableros, así que basta con calcularlas una vez.
+ *   Con `wrap` el vecino de un borde es el bloque del borde opuesto: el
+ *   módulo se hace aquí, una vez por celda, y ni mover la cabeza ni
+ *   sondear el bloque frontal necesitan `%` ni comprobar bordes. Si se
+ *   compila con WRAP_EDGES el tablero es siempre toroidal.
+ */
+void initializeBoardTables(int wrap) {
+    static const int dx[4] = { 1, -1, 0, 0 };    // por motion
+    static const int dy[4] = { 0, 0, -1, 1 };
+
+    for (int b = 0; b < MAX_BLOCKS; b++) {
+        int x = b % BLOCK_COLS, y = b / BLOCK_COLS;
+        ledOffsetTable[b] = (unsigned int)(y * BLOCK_SIZE * LED_MATRIX_0_WIDTH + x * BLOCK_SIZE);
+        for (int d = 0; d < 4; d++) {
+            int nx = x + dx[d], ny = y + dy[d];
+            if (wrap || WRAP_EDGES) {
+                nx = (nx + BLOCK_COLS) % BLOCK_COLS;
+                ny = (ny + BLOCK_ROWS) % BLOCK_ROWS;
             }
+            stepTable[d][b] = (nx < 0 || nx >= BLOCK_COLS || ny < 0 || ny >= BLOCK_ROWS)
+                            ? NO_BLOCK : (short)(ny * BLOCK_COLS + nx);
+        }
+    }
+}
+
+/**
+ * initializeBoard:
+ *   Asocia el tablero a la matriz LED y fija sus dimensiones. Con
+ *   ledBase == NULL el tablero no tiene pantalla: la etapa de render
+ *   no anota ni vuelca nada (simulación sin cabeza). Supone la matriz
+ *   apagada (limpiarPantalla al arrancar).
+ */
+void initializeBoard(BoardType* board, volatile unsigned int* ledBase) {
+    for (int i = 0; i < MAX_BLOCKS; i++) {
+        board->shown[i]   = BLACK;
+        board->pending[i] = NO_COLOR;
+    }
+    board->dirtyCount   = 0;
+    board->litCount     = 0;
+    board->level        = NULL;
+    board->paintedLevel = NULL;
+    board->ledBase = ledBase;
+    board->width   = LED_MATRIX_0_WIDTH;
+    board->cols    = BLOCK_COLS;
+    board->rows    = BLOCK_ROWS;
+    resetBoard(board);
+}
 
-            // 7.7) Retardo para controlar la velocidad del juego
-            delay_ms(1);
+/**
+ * resetBoard:
+ *   Deja la rejilla como al empezar la partida (vacía salvo los muros
+ *   del nivel). Supone apagado todo lo que no es muro (limpiarPantalla
+ *   al arrancar, clearTouched al reiniciar), así que la etapa de render
+ *   solo descarta lo que quede en las listas de sucios y encendidos,
+ *   sin recorrer el tablero. Los muros que ya se ven se dejan como
+ *   están; solo si el nivel ha cambiado se pintan los nuevos y se
+ *   apagan los que ya no tiene. La rejilla sí se rehace entera
+ *   (resetCells) para que el conjunto libre dependa solo del nivel.
+ */
+void resetBoard(BoardType* board) {
+    for (int i = 0; i < board->dirtyCount; i++)
+        board->pending[board->dirty[i]] = NO_COLOR;
+    for (int i = 0; i < board->litCount; i++)
+        board->shown[board->lit[i]] = BLACK;
+    board->dirtyCount = 0;
+    board->litCount   = 0;
+    board->mmioWrites = 0;
+    resetCells(board);
+    if (board->level == board->paintedLevel) return;
+    for (int i = 0; i < board->cols * board->rows; i++) {
+        int wall = board->cells[i] == CELL_WALL;
+        if (wall != (board->shown[i] == WALL_COLOR))
+            paintBlock(board, i, wall ? WALL_COLOR : BLACK);
+    }
+    board->paintedLevel = board->level;
+}
+
+/**
+ * resetCells:
+ *   Parte lógica de resetBoard: descomprime los tramos del nivel
+ *   directamente en la rejilla (muro o vacío) y forma a la vez el
+ *   conjunto libre con los vacíos en orden de índice, en una sola
+ *   pasada y sin reservar memoria. No toca la etapa de render, así que
+ *   sirve para reconstruir la rejilla con la pantalla encendida.
+ */
+void resetCells(BoardType* board) {
+    const LevelType* level = board->level;
+    int total = board->cols * board->rows;
+    int count = level ? level->count : 0;
+
+    board->freeCount = 0;
+    for (int i = 0, b = 0; b < total; i++) {
+        // Tras el último tramo, libre hasta el final
+        int wall = i < count && (i & 1);
+        int end  = i < count ? b + level->runs[i] : total;
+        if (end > total) end = total;
+        for (; b < end; b++) {
+            board->cells[b] = (unsigned char)(wall ? CELL_WALL : CELL_EMPTY);
+            if (wall) continue;
+            board->freeSlots[board->freeCount] = (unsigned short)b;
+            board->slotOf[b] = (unsigned short)board->freeCount++;
         }
+    }
+}
 
-        // 8) Liberar memoria de la partida terminada
-        free(apple->sections);
-        free(apple);
-        freeSnake(snake);
-
-        
-        // 9) Parpadeo de LED esquina en naranja esperando SW0
-        volatile unsigned int* corner_led = ledBase;  // puntero a LED [0,0]
-        while (!(*switch_base & SW0)) {
-            // Enciende naranja
-            *corner_led = ORANGE_COLOR;
-            delay_ms(2);
-            // Apaga
-            *corner_led = BLACK;
-            delay_ms(2);
+/**
+ * setCell:
+ *   Cambia el contenido de un bloque en la rejilla. Si el bloque pasa
+ *   de vacío a ocupado se saca del conjunto libre intercambiándolo con
+ *   el último elemento; si pasa de ocupado a vacío se añade al final.
+ *   Ambos casos son O(1).
+ */
+void setCell(BoardType* board, int block, CellType type) {
+    int wasFree = board->cells[block] == CELL_EMPTY;
+    int isFree  = type == CELL_EMPTY;
+    board->cells[block] = (unsigned char)type;
+
+    if (wasFree && !isFree) {
+        int slot = board->slotOf[block];
+        int last = board->freeSlots[--board->freeCount];
+        board->freeSlots[slot] = (unsigned short)last;
+        board->slotOf[last]    = (unsigned short)slot;
+    }
+    else if (!wasFree && isFree) {
+        board->freeSlots[board->freeCount] = (unsigned short)block;
+        board->slotOf[block] = (unsigned short)board->freeCount++;
+    }
+}
+
+/**
+ * blockLed:
+ *   Convierte un índice de bloque en el puntero al LED superior
+ *   izquierdo de su bloque en la matriz (consulta a tabla).
+ */
+volatile unsigned int* blockLed(BoardType* board, int block) {
+    return board->ledBase + ledOffsetTable[block];
+}
+
+/**
+ * paintBlock:
+ *   No escribe en la matriz: anota `color` como color pendiente del
+ *   bloque y lo añade a la lista de sucios si aún no estaba. Varias
+ *   peticiones sobre el mismo bloque en un tick se funden en la última.
+ *   Sin pantalla (ledBase NULL) no hace nada.
+ */
+void paintBlock(BoardType* board, int block, unsigned int color) {
+    if (!board->ledBase) return;
+    if (board->pending[block] == NO_COLOR)
+        board->dirty[board->dirtyCount++] = (unsigned short)block;
+    board->pending[block] = color;
+}
+
+/**
+ * renderFlush:
+ *   Vuelca a la matriz LED los bloques sucios del tick:
+ *   - Descarta los que acaban con el mismo color que ya muestran.
+ *   - Ordena el resto por índice (inserción: la lista es corta) y los
+ *     escribe fila de bloque a fila de bloque, recorriendo las
+ *     BLOCK_SIZE líneas de LEDs de todos ellos una tras otra, de modo
+ *     que las escrituras MMIO salen en orden creciente de dirección.
+ *   Devuelve (y guarda en board->mmioWrites) el número de escrituras.
+ */
+unsigned int renderFlush(BoardType* board) {
+    unsigned short* dirty = board->dirty;
+    int n = 0;
+
+    // 1) Quedarse solo con los bloques cuyo color cambia de verdad
+    for (int i = 0; i < board->dirtyCount; i++) {
+        int b = dirty[i];
+        unsigned int c = board->pending[b];
+        board->pending[b] = NO_COLOR;
+        if (c == board->shown[b]) continue;
+        int wasLit = board->shown[b] != BLACK && board->shown[b] != WALL_COLOR;
+        int isLit  = c != BLACK && c != WALL_COLOR;
+        if (!wasLit && isLit) {                   // se enciende
+            board->lit[board->litCount] = (unsigned short)b;
+            board->litSlot[b] = (unsigned short)board->litCount++;
+        }
+        else if (wasLit && !isLit) {              // se apaga
+            int slot = board->litSlot[b];
+            int last = board->lit[--board->litCount];
+            board->lit[slot]     = (unsigned short)last;
+            board->litSlot[last] = (unsigned short)slot;
+        }
+        board->shown[b] = c;
+
+        // 2) Inserción ordenada por índice de bloque
+        int j = n++;
+        while (j > 0 && dirty[j - 1] > b) {
+            dirty[j] = dirty[j - 1];
+            j--;
         }
-        // Al pulsar SW0, sale del bucle y reinicia la partida
+        dirty[j] = (unsigned short)b;
+    }
+    board->dirtyCount = 0;
+
+    // 3) Escribir cada fila de bloques línea a línea de LEDs
+    int width = board->width;
+    unsigned int writes = 0;
+    for (int start = 0; start < n; ) {
+        int row = dirty[start] / BLOCK_COLS;
+        int end = start;
+        while (end < n && dirty[end] / BLOCK_COLS == row) end++;
+
+        for (int line = 0; line < BLOCK_SIZE; line++) {
+            for (int i = start; i < end; i++) {
+                volatile unsigned int* led = blockLed(board, dirty[i]) + line * width;
+                unsigned int c = board->shown[dirty[i]];
+                for (int k = 0; k < BLOCK_SIZE; k++)
+                    led[k] = c;
+                writes += BLOCK_SIZE;
+            }
+        }
+        start = end;
     }
 
-    return 0;
+    board->mmioWrites = writes;
+    return writes;
+}
+
+/**
+ * clearTouched:
+ *   Apaga (vía la etapa de render) hasta `budget` de los bloques que la
+ *   matriz muestra encendidos y los vuelca. Como todo bloque ocupado
+ *   que no es muro está encendido, repetirlo hasta 0 apaga exactamente
+ *   lo que tocó la partida anterior: el coste depende de eso y no del
+ *   tamaño de la matriz. Los muros no se tocan. Devuelve los bloques
+ *   que siguen encendidos.
+ */
+int clearTouched(BoardType* board, int budget) {
+    int n = board->litCount < budget ? board->litCount : budget;
+    for (int i = board->litCount - n; i < board->litCount; i++)
+        paintBlock(board, board->lit[i], BLACK);
+    renderFlush(board);
+    return board->litCount;
 }
 
 
-/*─── IMPLEMENTACIONES: APPLE ────────────────────────────────────────────────*/
+/*─── IMPLEMENTACIONES: NIVELES ─────────────────────────────────────────────*/
+
+/**
+ * setLevel:
+ *   Asocia el nivel al tablero; la rejilla lo aplica en el siguiente
+ *   resetBoard/resetCells. Un nivel de otras dimensiones se rechaza y
+ *   el tablero se queda sin muros. Devuelve 1 si se acepta.
+ */
+int setLevel(BoardType* board, const LevelType* level) {
+    if (level && (level->cols != board->cols || level->rows != board->rows)) {
+        printf("nivel de %dx%d bloques no válido para un tablero de %dx%d\n",
+               level->cols, level->rows, board->cols, board->rows);
+        board->level = NULL;
+        return 0;
+    }
+    board->level = level;
+    return 1;
+}
+
+/**
+ * levelChecksum:
+ *   FNV-1a de 32 bits sobre los índices de los bloques muro del nivel,
+ *   recorriendo sus tramos sin descomprimirlos en la rejilla. No depende
+ *   de cómo se partan los tramos, así que dos niveles con los mismos
+ *   muros dan el mismo valor. Sin nivel o sin muros devuelve 0.
+ */
+unsigned int levelChecksum(const LevelType* level) {
+    unsigned int h = 2166136261u;
+    int walls = 0;
+    if (!level) return 0;
+
+    int total = level->cols * level->rows;
+    for (int i = 0, b = 0; i < level->count && b < total; i++) {
+        int end = b + level->runs[i];
+        if (end > total) end = total;
+        if (!(i & 1)) {
+            b = end;
+            continue;
+        }
+        for (; b < end; b++, walls++)
+            h = (h ^ (unsigned int)b) * 16777619u;
+    }
+    return walls ? h : 0;
+}
 
 /**
- * initializeApple:
- *   Reserva una estructura AppleType y un array de 4 punteros para
- *   las secciones de la manzana. No coloca aún la manzana en pantalla.
+ * decodeLevel:
+ *   Interpreta un nivel serializado en little-endian: magic "SNL1",
+ *   ancho y alto en bloques y número de tramos (16 bits) y los tramos
+ *   (un byte cada uno). Los tramos no se copian: `level` apunta dentro
+ *   de `in`. Comprueba que no cubran más bloques que el tablero.
+ *   Devuelve 1 si el nivel es válido.
  */
-AppleType* initializeApple(volatile unsigned int* ledBase, int width) {
-    AppleType* a = malloc(sizeof(*a));
-    a->sections  = malloc(4 * sizeof(*(a->sections)));
-    return a;
+int decodeLevel(LevelType* level, const unsigned char* in, int len) {
+    if (len < LEVEL_HEADER) return 0;
+
+    unsigned int magic = in[0] | in[1] << 8 | in[2] << 16 | (unsigned int)in[3] << 24;
+    int cols  = in[4] | in[5] << 8;
+    int rows  = in[6] | in[7] << 8;
+    int count = in[8] | in[9] << 8;
+    if (magic != LEVEL_MAGIC || len != LEVEL_HEADER + count) return 0;
+
+    long covered = 0;
+    for (int i = 0; i < count; i++) covered += in[LEVEL_HEADER + i];
+    if (covered > (long)cols * rows) return 0;
+
+    level->cols  = (unsigned short)cols;
+    level->rows  = (unsigned short)rows;
+    level->count = (unsigned short)count;
+    level->runs  = in + LEVEL_HEADER;
+    return 1;
 }
 
+/**
+ * loadLevel:
+ *   Pide al host un nivel (en Ripes nunca hay). Los tramos se quedan
+ *   en un búfer estático. Devuelve 1 si hay un nivel válido.
+ */
+int loadLevel(LevelType* level) {
+    static unsigned char buf[LEVEL_BYTES];
+    int len = RIPES_HOST_LEVEL(buf, LEVEL_BYTES);
+    if (len <= 0) return 0;
+
+    if (!decodeLevel(level, buf, len)) {
+        printf("nivel no válido\n");
+        return 0;
+    }
+    return 1;
+}
+
+
+/*─── IMPLEMENTACIONES: APPLE ────────────────────────────────────────────────*/
+
 /**
  * generateApplePosition:
- *   Usa randomPosition para obtener un índice lineal válido para un
- *   bloque 2×2. Asigna los cuatro punteros de apple->sections
- *   apuntando a esa posición (esquina sup-izq y sus tres LEDs vecinos).
- *   Devuelve el índice lineal para usar como semilla la próxima vez.
+ *   Elige de una sola tirada un bloque del conjunto de bloques libres
+ *   (uniforme entre ellos, sin reintentos) y lo guarda en apple->block.
+ *   Devuelve el bloque, o -1 si no queda ninguno libre.
  */
-int generateApplePosition(AppleType* apple, volatile unsigned int* ledBase, int width, int height, int seed) {
-    int pos = randomPosition(width, height, seed);
-    apple->sections[0] = ledBase + pos;
-    apple->sections[1] = ledBase + pos + 1;
-    apple->sections[2] = ledBase + pos + width;
-    apple->sections[3] = ledBase + pos + width + 1;
-    return pos;
+int generateApplePosition(AppleType* apple, BoardType* board, unsigned int* rng) {
+    if (board->freeCount == 0) return -1;
+
+    // Escala el número aleatorio a [0, freeCount) sin división
+    unsigned int slot = (unsigned int)(((unsigned long long)nextRandom(rng) * board->freeCount) >> 32);
+    apple->block = board->freeSlots[slot];
+    return apple->block;
 }
 
 /**
  * updateApple:
- *   Borra la manzana actual (poniendo BLACK en oldLEDs),
- *   genera una nueva posición aleatoria repetidamente hasta
- *   encontrar una zona libre (isFreeZone), y pinta la nueva
- *   manzana con APPLE_COLOR.
- */
-void updateApple(AppleType* apple, volatile unsigned int* ledBase, int width, int height, int* seed) {
-    // Guardar punteros antiguos para borrarlos
-    volatile unsigned int* oldLEDs[4] = {
-        apple->sections[0],
-        apple->sections[1],
-        apple->sections[2],
-        apple->sections[3]
-    };
-
-    // Reubicar hasta hallar zona libre
-    do {
-        *seed = generateApplePosition(apple, ledBase, width, height, *seed);
-    } while (!isFreeZone(ledBase, *seed, width));
+ *   Coloca la manzana en un bloque libre elegido al azar, lo marca
+ *   como CELL_APPLE en la rejilla y pinta la nueva manzana con
+ *   APPLE_COLOR. Devuelve 0 si el tablero está lleno (victoria).
+ *   La manzana anterior no se borra: se llama después de growSnake,
+ *   cuando la cabeza ya ocupa (y ha pintado) ese bloque.
+ */
+int updateApple(AppleType* apple, BoardType* board, unsigned int* rng) {
+    if (generateApplePosition(apple, board, rng) < 0)
+        return 0;
 
-    // Borrar colores de la vieja manzana
-    paintLEDs(oldLEDs, 4, BLACK);
+    setCell(board, apple->block, CELL_APPLE);
     // Pintar la nueva manzana
-    paintLEDs(apple->sections, 4, APPLE_COLOR);
+    paintBlock(board, apple->block, APPLE_COLOR);
+    return 1;
 }
 
 
@@ -276,246 +1288,1227 @@ void updateApple(AppleType* apple, volatile unsigned int* ledBase, int width, in
 /*─── IMPLEMENTACIONES: SNAKE ────────────────────────────────────────────────*/
 
 /**
- * initializeSnake:
- *   Reserva y retorna una estructura SnakeType con un solo bloque 2×2
- *   en la esquina superior-izquierda. Tanto head como tail apuntan
- *   a ese primer nodo, y se pinta con SNAKE_COLOR.
+ * packedGet / packedPut:
+ *   Leen y escriben el campo de 2 bits número `pos` de un array
+ *   empaquetado (cuatro por byte, el primero en los bits bajos).
+ */
+static int packedGet(const unsigned char* bits, int pos) {
+    return (bits[pos >> 2] >> ((pos & 3) * 2)) & 3;
+}
+
+static void packedPut(unsigned char* bits, int pos, int value) {
+    int shift = (pos & 3) * 2;
+    bits[pos >> 2] = (unsigned char)((bits[pos >> 2] & ~(3 << shift)) | (value << shift));
+}
+
+/**
+ * segmentDir:
+ *   Paso número `i` del cuerpo contando desde la cola (0 = el que lleva
+ *   de la cola al segundo segmento).
+ */
+static int segmentDir(const SnakeType* s, int i) {
+    int pos = s->first + i;
+    return packedGet(s->dirs, pos >= MAX_BLOCKS ? pos - MAX_BLOCKS : pos);
+}
+
+/**
+ * pushSegmentDir:
+ *   Anota el paso de la cabeza tras los length-1 que ya hay. El anillo
+ *   tiene sitio para MAX_BLOCKS pasos, así que nunca pisa el de la cola.
  */
-SnakeType* initializeSnake(volatile unsigned int* ledBase, int width) {
-    SnakeType* s = (SnakeType*)malloc(sizeof(SnakeType));
-    Node* initial = createNode(ledBase, width);
-    s->head   = initial;
-    s->tail   = initial;
-    s->length = 1;
-    paintLEDs(initial->leds, 4, SNAKE_COLOR);
-    return s;
+static void pushSegmentDir(SnakeType* s, motion dir) {
+    int pos = s->first + s->length - 1;
+    packedPut(s->dirs, pos >= MAX_BLOCKS ? pos - MAX_BLOCKS : pos, dir);
+}
+
+/**
+ * startSnake:
+ *   Deja la serpiente con un solo bloque en `block`: cabeza y cola son
+ *   el mismo bloque y no hay pasos. Se marca en la rejilla y se pinta
+ *   con su color.
+ */
+void startSnake(SnakeType* s, BoardType* board, int block, unsigned int color) {
+    s->first   = 0;
+    s->head    = (unsigned short)block;
+    s->tail    = (unsigned short)block;
+    s->length  = 1;
+    s->color   = color;
+    setCell(board, block, CELL_SNAKE);
+    paintBlock(board, block, color);
 }
 
 /**
  * motionSnake:
  *   Avanza la serpiente un bloque en currentDir sin crecer.
- *   Apaga la cola, recicla ese nodo como nueva cabeza,
- *   actualiza sus LEDs al nuevo bloque y los enciende.
- */
-void motionSnake(SnakeType* snake, motion currentDir, int width) {
-    volatile unsigned int* oldHead = snake->head->leds[0];
-    volatile unsigned int* newBase = computeNewHeadBase(oldHead, currentDir, width);
-
-    volatile unsigned int* newLeds[4] = {
-        newBase,
-        newBase + 1,
-        newBase + width,
-        newBase + width + 1
+ *   Apaga el bloque de la cola y la libera en la rejilla, anota el paso
+ *   de la cabeza y adelanta la cola siguiendo el paso más antiguo, que
+ *   se descarta. El nuevo bloque cabeza se ocupa y se enciende.
+ *   Con longitud 1 no hay pasos: la cola pasa a ser la nueva cabeza.
+ */
+void motionSnake(SnakeType* snake, BoardType* board, motion currentDir) {
+    int newBlock  = stepTable[currentDir][snake->head];
+    int tailBlock = snake->tail;
+
+    // 1) Apagar y liberar el bloque de la cola
+    setCell(board, tailBlock, CELL_EMPTY);
+    paintBlock(board, tailBlock, BLACK);
+
+    // 2) Anotar el paso de la cabeza y avanzar la cola por el suyo
+    if (snake->length > 1) {
+        pushSegmentDir(snake, currentDir);
+        snake->tail = (unsigned short)stepTable[segmentDir(snake, 0)][tailBlock];
+        if (++snake->first == MAX_BLOCKS) snake->first = 0;
+    }
+    else {
+        snake->tail = (unsigned short)newBlock;
+    }
+    snake->head = (unsigned short)newBlock;
+
+    // 3) Ocupar y pintar el nuevo bloque cabeza
+    setCell(board, newBlock, CELL_SNAKE);
+    paintBlock(board, newBlock, snake->color);
+}
+
+
+
+/**
+ * growSnake:
+ *   Añade el bloque frontal como nueva cabeza sin tocar la cola
+ *   (solo anota un paso más), lo marca en la rejilla
+ *   y enciende sus LEDs.
+ */
+void growSnake(SnakeType* snake, BoardType* board, motion currentDir) {
+    int newBlock = stepTable[currentDir][snake->head];
+
+    pushSegmentDir(snake, currentDir);
+    snake->head = (unsigned short)newBlock;
+    snake->length++;
+    setCell(board, newBlock, CELL_SNAKE);
+    paintBlock(board, newBlock, snake->color);
+}
+
+/**
+ * isObstacle:
+ *   Indica si entrar en el bloque mata: serpiente (viva o muerta) o muro.
+ */
+static int isObstacle(BoardType* board, int block) {
+    return board->cells[block] == CELL_SNAKE || board->cells[block] == CELL_WALL;
+}
+
+/**
+ * checkCollision:
+ *   Consulta en la rejilla de ocupación el bloque al que va a entrar
+ *   la cabeza. Devuelve COLLISION_SELF si lo ocupa una serpiente,
+ *   COLLISION_WALL si es un muro, COLLISION_APPLE si está la manzana,
+ *   o NONE si está vacío.
+ *   No depende de los colores de la matriz LED y se resuelve con una
+ *   consulta a tabla indexada por CellType, sin ramas.
+ */
+CollisionType checkCollision(BoardType* board, int block) {
+    static const unsigned char collisionOf[] = {
+        [CELL_EMPTY] = COLLISION_NONE,
+        [CELL_SNAKE] = COLLISION_SELF,
+        [CELL_APPLE] = COLLISION_APPLE,
+        [CELL_WALL]  = COLLISION_WALL
     };
+    return (CollisionType)collisionOf[board->cells[block]];
+}
 
-    if (snake->length == 1) {
-        // Caso especial: solo hay un nodo, reubica sus LEDs directamente
-        paintLEDs(snake->head->leds, 4, BLACK);
-        for (int i = 0; i < 4; i++)
-            snake->head->leds[i] = newLeds[i];
-        paintLEDs(snake->head->leds, 4, SNAKE_COLOR);
-        return;
+
+
+/*─── IMPLEMENTACIONES: MUNDO ───────────────────────────────────────────────*/
+
+/**
+ * spawnBlock:
+ *   Bloque de salida de una serpiente: el primero libre bajando por la
+ *   columna `x` (sin muros, la fila superior) o, si está entera ocupada,
+ *   por las siguientes.
+ */
+static int spawnBlock(BoardType* board, int x) {
+    int total = board->cols * board->rows;
+    for (int c = 0; c < board->cols; c++) {
+        int col = x + c < board->cols ? x + c : x + c - board->cols;
+        for (int b = col; b < total; b += board->cols)
+            if (board->cells[b] == CELL_EMPTY) return b;
+    }
+    return board->freeSlots[0];
+}
+
+/**
+ * initializeWorld:
+ *   Deja vacía la reserva de bloques frontales. Basta una vez: su
+ *   marca sigue corriendo de una partida a otra, así que resetWorld no
+ *   recorre el tablero.
+ */
+void initializeWorld(WorldType* w) {
+    for (int b = 0; b < MAX_BLOCKS; b++) w->claim[b] = 0;
+    w->stamp = 0;
+}
+
+/**
+ * resetWorld:
+ *   Empieza una partida sobre un tablero ya vacío. Las serpientes salen
+ *   de la fila superior repartidas por columnas (la 0 en la esquina,
+ *   como siempre) hacia abajo; si el nivel pone un muro ahí, del primer
+ *   bloque libre de su columna. El generador de manzanas se siembra con
+ *   `seed` y cada guion con una semilla derivada, de modo que con una
+ *   sola serpiente y una manzana la partida es la misma que antes.
+ */
+void resetWorld(WorldType* w, BoardType* board, int snakes, int apples, unsigned int seed) {
+    w->board      = board;
+    w->snakeCount = snakes;
+    w->appleCount = apples;
+    w->liveCount  = snakes;
+    w->ticks      = 0;
+
+    initializeRandom(&w->rng, seed);
+    for (int i = 0; i < snakes; i++) {
+        startSnake(&w->snakes[i], board, spawnBlock(board, i * board->cols / snakes),
+                   i ? RIVAL_COLOR : SNAKE_COLOR);
+        w->alive[i]   = 1;
+        w->control[i] = (unsigned char)(i ? RIVAL_CONTROL : CONTROL_DPAD);
+        w->dir[i]     = DOWN;
+        initializeRandom(&w->scriptRng[i], seed ^ (0x9E3779B9u * (unsigned int)(i + 1)));
+    }
+    for (int k = 0; k < apples; k++) {
+        w->apples[k].block = -1;
+        updateApple(&w->apples[k], board, &w->rng);
+    }
+}
+
+/**
+ * steerSnakes:
+ *   Decide la dirección de este tick de cada serpiente viva que no se
+ *   controla con el D-Pad. Las automáticas van a "su" manzana (índice
+ *   módulo M) o, si esa no está en el tablero, a la primera que haya.
+ */
+void steerSnakes(WorldType* w, AutopilotType* ai) {
+    for (int i = 0; i < w->snakeCount; i++) {
+        if (!w->alive[i] || w->control[i] == CONTROL_DPAD) continue;
+        SnakeType* s = &w->snakes[i];
+        if (w->control[i] == CONTROL_SCRIPT) {
+            w->dir[i] = (unsigned char)scriptDirection(w->board, s, &w->scriptRng[i],
+                                                       (motion)w->dir[i]);
+            continue;
+        }
+        AppleType* target = &w->apples[i % w->appleCount];
+        for (int k = 0; target->block < 0 && k < w->appleCount; k++)
+            target = &w->apples[k];
+        w->dir[i] = (unsigned char)autopilotDirection(ai, w->board, s, target,
+                                                      (motion)w->dir[i]);
+    }
+}
+
+/**
+ * scriptDirection:
+ *   Jugador guionizado: sigue recto y, con probabilidad 1/8, gira a
+ *   izquierda o derecha (nunca 180°). Evita meterse en un bloque que
+ *   le mataría si tiene alternativa, como haría una persona atenta.
+ */
+motion scriptDirection(BoardType* board, SnakeType* snake, unsigned int* rng, motion dir) {
+    // Giros relativos por motion: izquierda y derecha de cada dirección
+    static const unsigned char turn[4][2] = {
+        [RIGHT] = { UP, DOWN }, [LEFT] = { DOWN, UP },
+        [UP]    = { LEFT, RIGHT }, [DOWN] = { RIGHT, LEFT },
+    };
+    int head = snake->head;
+    unsigned int r = nextRandom(rng);
+    motion want = (r & 7) ? dir : (motion)turn[dir][(r >> 3) & 1];
+
+    motion options[3] = { want, (motion)turn[dir][0], (motion)turn[dir][1] };
+    if (want != dir) options[1] = dir;
+    for (int i = 0; i < 3; i++) {
+        int n = stepTable[options[i]][head];
+        if (n != NO_BLOCK && !isObstacle(board, n)) return options[i];
     }
+    return want;
+}
 
-    // CASO GENERAL: longitud >= 2
-    // 1) Apagar LEDs de la cola
-    paintLEDs(snake->tail->leds, 4, BLACK);
+/**
+ * stepWorld:
+ *   Núcleo del bucle interior: avanza un tick todas las serpientes vivas
+ *   en sus direcciones w->dir. No lee entrada, no espera ni vuelca el
+ *   render, así que sirve igual para main que para los simuladores.
+ *   1) Con el estado del tick anterior se decide el destino de cada una:
+ *      muere si se sale del tablero, si su bloque frontal es de una
+ *      serpiente (cabeza contra cuerpo, incluida la cola) o si otra
+ *      entra en el mismo bloque (cabeza contra cabeza: mueren ambas);
+ *      si no, come o avanza.
+ *   2) Los destinos se aplican en orden de índice. Las muertas se quedan
+ *      en el tablero como obstáculo.
+ *   3) Las manzanas comidas se reponen en ese mismo orden, cuando el
+ *      conjunto de bloques libres ya es el del final del tick.
+ */
+StepResult stepWorld(WorldType* w) {
+    static const unsigned char fateOf[] = {
+        [COLLISION_NONE]  = FATE_MOVE,
+        [COLLISION_SELF]  = FATE_DIE,
+        [COLLISION_APPLE] = FATE_EAT,
+        [COLLISION_WALL]  = FATE_DIE
+    };
+    BoardType* board = w->board;
+    short eaten[MAX_SNAKES];
+    int ate = 0;
+
+    w->ticks++;
+    if (++w->stamp == 0) {                    // vuelta del contador: limpiar
+        for (int b = 0; b < MAX_BLOCKS; b++) w->claim[b] = 0;
+        w->stamp = 1;
+    }
 
-    // 2) Guardar el nodo tail para reciclar
-    Node* recycled = snake->tail;
+    // 1) Destino de cada serpiente viva
+    for (int i = 0; i < w->snakeCount; i++) {
+        if (!w->alive[i]) continue;
+        SnakeType* s = &w->snakes[i];
+
+        PROFILE_BEGIN(PHASE_BOUNDS);
+        int front = stepTable[w->dir[i]][s->head];
+        PROFILE_END(PHASE_BOUNDS);
+        w->front[i] = (short)front;
+        // En un tablero toroidal no hay bordes: la comprobación desaparece
+        if (!WRAP_EDGES && front == NO_BLOCK) { w->fate[i] = FATE_DIE; continue; }
+
+        if (w->claim[front] == w->stamp) {    // cabeza contra cabeza
+            w->fate[i] = FATE_DIE;
+            w->fate[w->claimer[front]] = FATE_DIE;
+            continue;
+        }
+        w->claim[front]   = w->stamp;
+        w->claimer[front] = (unsigned char)i;
 
-    // 3) Mover el tail al siguiente
-    snake->tail = recycled->next;
+        PROFILE_BEGIN(PHASE_PROBE);
+        w->fate[i] = fateOf[checkCollision(board, front)];
+        PROFILE_END(PHASE_PROBE);
+    }
 
-    // 4) Desconectar el nodo reciclado
-    recycled->next = NULL;
+    // 2) Aplicar los destinos en orden de índice
+    for (int i = 0; i < w->snakeCount; i++) {
+        if (!w->alive[i]) continue;
+        SnakeType* s = &w->snakes[i];
 
-    // 5) Actualizar los punteros de LEDs
-    for (int i = 0; i < 4; i++)
-        recycled->leds[i] = newLeds[i];
+        if (w->fate[i] == FATE_DIE) {
+            w->alive[i] = 0;
+            w->liveCount--;
+            continue;
+        }
+        PROFILE_BEGIN(PHASE_MOVE);
+        if (w->fate[i] == FATE_EAT) {
+            int k = 0;
+            while (w->apples[k].block != w->front[i]) k++;
+            eaten[ate++] = (short)k;
+            growSnake(s, board, (motion)w->dir[i]);
+        } else {
+            motionSnake(s, board, (motion)w->dir[i]);
+        }
+        PROFILE_END(PHASE_MOVE);
+    }
 
-    // 6) Insertar el nodo reciclado como nuevo head
-    recycled->next = NULL;
-    snake->head->next = recycled;
-    snake->head = recycled;
+    // 3) Reponer las manzanas comidas; si alguna no cabe y no queda
+    //    ninguna en el tablero, el tablero está lleno
+    int starved = 0;
+    for (int j = 0; j < ate; j++) {
+        AppleType* apple = &w->apples[eaten[j]];
+        PROFILE_BEGIN(PHASE_APPLE);
+        int placed = updateApple(apple, board, &w->rng);
+        PROFILE_END(PHASE_APPLE);
+        if (!placed) { apple->block = -1; starved = 1; }
+    }
+    if (starved) {
+        int left = 0;
+        for (int k = 0; k < w->appleCount; k++) left += w->apples[k].block >= 0;
+        if (!left) return STEP_WON;
+    }
 
-    // 7) Pintar los LEDs del nuevo bloque cabeza
-    paintLEDs(recycled->leds, 4, SNAKE_COLOR);
+    if (w->liveCount == 0) return STEP_DEAD;
+    return ate ? STEP_ATE : STEP_MOVED;
 }
 
 
+/*─── IMPLEMENTACIONES: INSTANTÁNEAS ────────────────────────────────────────*/
 
 /**
- * growSnake:
- *   Crea un nuevo nodo 2×2 en front de la cabeza sin tocar la cola,
- *   enlaza ese nodo como nueva cabeza y enciende sus LEDs.
+ * ringBytes:
+ *   Bytes del anillo de `s` que contienen sus pasos: devuelve cuántos
+ *   hay desde el byte del paso de la cola (hasta el final del anillo si
+ *   da la vuelta) y deja en `wrapped` los que siguen desde el byte 0.
  */
-void growSnake(SnakeType* snake, motion currentDir, int width) {
-    volatile unsigned int* oldHead = snake->head->leds[0];
-    volatile unsigned int* newBase = computeNewHeadBase(oldHead, currentDir, width);
+static int ringBytes(const SnakeType* s, int* wrapped) {
+    int steps = s->length - 1;
+    int last  = s->first + steps - 1;
+
+    *wrapped = 0;
+    if (steps <= 0) return 0;
+    if (last < MAX_BLOCKS) return (last >> 2) - (s->first >> 2) + 1;
+    *wrapped = ((last - MAX_BLOCKS) >> 2) + 1;
+    return BODY_BYTES - (s->first >> 2);
+}
 
-    Node* newNode = createNode(newBase, width);
-    snake->head->next = newNode;
-    snake->head   = newNode;
-    snake->length++;
-    paintLEDs(newNode->leds, 4, SNAKE_COLOR);
+/**
+ * takeSnapshot:
+ *   Copia en `snap` el estado del mundo: tick, generadores, cabeza,
+ *   longitud, dirección y vida de cada serpiente, manzanas y los bytes
+ *   de cada anillo de pasos con su posición de inicio (dos memcpy si el
+ *   anillo da la vuelta). Sin desempaquetar ni tocar el tablero.
+ */
+void takeSnapshot(WorldType* w, SnapshotType* snap) {
+    unsigned char* out = snap->body;
+
+    snap->tick = w->ticks;
+    snap->rng  = w->rng;
+    for (int i = 0; i < w->snakeCount; i++) {
+        SnakeType* s = &w->snakes[i];
+        snap->scriptRng[i] = w->scriptRng[i];
+        snap->head[i]      = s->head;
+        snap->length[i]    = (unsigned short)s->length;
+        snap->dir[i]       = (unsigned char)(w->dir[i] | (w->alive[i] << 2));
+        snap->first[i]     = (unsigned short)s->first;
+        int wrapped, n = ringBytes(s, &wrapped);
+        memcpy(out, s->dirs + (s->first >> 2), n);
+        memcpy(out + n, s->dirs, wrapped);
+        out += n + wrapped;
+    }
+    for (int k = 0; k < w->appleCount; k++)
+        snap->apples[k] = (short)w->apples[k].block;
 }
 
 /**
- * checkCollisionByColor:
- *   Lee los dos LEDs frontales apuntados en headLeds.
- *   Devuelve COLLISION_SELF si coincide con SNAKE_COLOR,
- *   COLLISION_APPLE si coincide con APPLE_COLOR, o NONE si ambos son BLACK.
+ * restoreSnapshot:
+ *   Devuelve el mundo a `snap`:
+ *   1) Pide apagar los bloques que ocupa ahora (cuerpos y manzanas).
+ *   2) Rehace la rejilla vacía con el conjunto libre en orden de índice.
+ *   3) Devuelve los bytes de cada anillo a su sitio, reconstruye el
+ *      cuerpo desde la cabeza hacia la cola deshaciendo los pasos (la
+ *      dirección opuesta es d ^ 1) y coloca las manzanas, ocupando y
+ *      pintando cada bloque.
+ *   Los bloques que acaban igual se descartan en renderFlush, así que
+ *   solo se escriben los que cambian. Como el conjunto libre se rehace,
+ *   las manzanas que salgan después dependen solo de la instantánea.
  */
-CollisionType checkCollisionByColor(volatile unsigned int* headLeds[2]) {
-    unsigned int c1 = *headLeds[0];
-    unsigned int c2 = *headLeds[1];
-    if (c1 == SNAKE_COLOR || c2 == SNAKE_COLOR) return COLLISION_SELF;
-    if (c1 == APPLE_COLOR || c2 == APPLE_COLOR) return COLLISION_APPLE;
-    return COLLISION_NONE;
+void restoreSnapshot(WorldType* w, const SnapshotType* snap) {
+    BoardType* board = w->board;
+    const unsigned char* in = snap->body;
+
+    // 1) Apagar el estado actual
+    for (int i = 0; i < w->snakeCount; i++) {
+        SnakeType* s = &w->snakes[i];
+        int block = s->tail;
+        paintBlock(board, block, BLACK);
+        for (int k = 0; k < s->length - 1; k++) {
+            block = stepTable[segmentDir(s, k)][block];
+            paintBlock(board, block, BLACK);
+        }
+    }
+    for (int k = 0; k < w->appleCount; k++)
+        if (w->apples[k].block >= 0) paintBlock(board, w->apples[k].block, BLACK);
+
+    // 2) Rejilla vacía
+    resetCells(board);
+
+    // 3) Serpientes y manzanas de la instantánea
+    w->ticks     = snap->tick;
+    w->rng       = snap->rng;
+    w->liveCount = 0;
+    for (int i = 0; i < w->snakeCount; i++) {
+        SnakeType* s = &w->snakes[i];
+        int block = snap->head[i];
+        w->scriptRng[i] = snap->scriptRng[i];
+        w->dir[i]       = snap->dir[i] & 3;
+        w->alive[i]     = snap->dir[i] >> 2;
+        w->liveCount   += w->alive[i];
+        s->head   = (unsigned short)block;
+        s->length = snap->length[i];
+        s->first  = snap->first[i];
+        int wrapped, n = ringBytes(s, &wrapped);
+        memcpy(s->dirs + (s->first >> 2), in, n);
+        memcpy(s->dirs, in + n, wrapped);
+        in += n + wrapped;
+
+        setCell(board, block, CELL_SNAKE);
+        paintBlock(board, block, s->color);
+        for (int k = s->length - 2; k >= 0; k--) {
+            block = stepTable[segmentDir(s, k) ^ 1][block];
+            setCell(board, block, CELL_SNAKE);
+            paintBlock(board, block, s->color);
+        }
+        s->tail = (unsigned short)block;
+    }
+    for (int k = 0; k < w->appleCount; k++) {
+        w->apples[k].block = snap->apples[k];
+        if (snap->apples[k] < 0) continue;
+        setCell(board, snap->apples[k], CELL_APPLE);
+        paintBlock(board, snap->apples[k], APPLE_COLOR);
+    }
 }
 
+void resetRewind(RewindType* rw) {
+    rw->next  = 0;
+    rw->count = 0;
+}
 
-/*─── IMPLEMENTACIONES: UTILIDADES ──────────────────────────────────────────*/
+/**
+ * rewindPush:
+ *   Guarda la instantánea del tick en curso; con el anillo lleno pisa
+ *   la más antigua.
+ */
+void rewindPush(RewindType* rw, WorldType* w) {
+    takeSnapshot(w, &rw->ring[rw->next]);
+    if (++rw->next == REWIND_TICKS) rw->next = 0;
+    if (rw->count < REWIND_TICKS) rw->count++;
+}
 
 /**
- * randomPosition:
- *   - Reinicia el generador de números aleatorios usando `seed`.
- *   - Calcula una coordenada X aleatoria entre [0, width-2]
- *     y una Y aleatoria entre [0, height-2], para que quepa
- *     un bloque 2×2 dentro de los límites.
- *   - Devuelve la posición lineal = y*width + x, que corresponde
- *     a la esquina superior izquierda de ese bloque 2×2.
+ * rewindBack:
+ *   Restaura la instantánea de hace `ticks` ticks (o la más antigua si
+ *   no hay tantas) y descarta las posteriores, de modo que el siguiente
+ *   rewindPush vuelve a guardar ese mismo tick. Devuelve los ticks
+ *   rebobinados (0 si el anillo está vacío).
  */
-int randomPosition(int width, int height, int seed) {
-    srand(seed);
-    int x = rand() % (width  - 1);
-    int y = rand() % (height - 1);
-    return y * width + x;
+int rewindBack(RewindType* rw, WorldType* w, int ticks) {
+    if (ticks > rw->count) ticks = rw->count;
+    if (ticks == 0) return 0;
+
+    int slot = rw->next - ticks;
+    if (slot < 0) slot += REWIND_TICKS;
+    restoreSnapshot(w, &rw->ring[slot]);
+    rw->next   = slot;
+    rw->count -= ticks;
+    return ticks;
 }
 
+
+
+/*─── IMPLEMENTACIONES: TEMPORIZACIÓN ───────────────────────────────────────*/
+
 /**
- * paintLEDs:
- *   - Recibe un array de punteros a LEDs y un color.
- *   - Itera desde i=0 hasta i<count-1 y asigna `color`
- *     al LED apuntado por cada puntero.
- *   - Se usa tanto para encender segmentos de la serpiente
- *     (SNAKE_COLOR) como para borrar (BLACK).
+ * readCycles:
+ *   Devuelve un contador monótono de 64 bits en unidades de CPU_HZ:
+ *   - En RISC-V lee el CSR cycle (rdcycle). En RV32 se lee la mitad alta
+ *     antes y después de la baja y se repite si ha cambiado entre medias.
+ *   - En el host usa el reloj monótono (nanosegundos).
+ *   Al ser asm volatile / llamada externa el optimizador no puede
+ *   eliminar las esperas que lo usan.
  */
-void paintLEDs(volatile unsigned int* leds[], int count, unsigned int color) {
-    for (int i = 0; i < count; i++)
-        *leds[i] = color;
+unsigned long long readCycles(void) {
+#if defined(RIPES_HOST)
+    return ripes_host_clock();
+#elif defined(__riscv) && __riscv_xlen == 32
+    unsigned int hi, lo, hi2;
+    do {
+        __asm__ volatile ("rdcycleh %0" : "=r"(hi));
+        __asm__ volatile ("rdcycle  %0" : "=r"(lo));
+        __asm__ volatile ("rdcycleh %0" : "=r"(hi2));
+    } while (hi != hi2);
+    return ((unsigned long long)hi << 32) | lo;
+#else
+    unsigned long long c;
+    __asm__ volatile ("rdcycle %0" : "=r"(c));
+    return c;
+#endif
 }
 
 /**
- * limpiarPantalla:
- *   - Recorre toda la matriz LED de tamaño width×height.
- *   - Asigna el color BLACK (apagado) a cada celda.
- *   - Se invoca al inicio del juego para empezar con pantalla limpia.
+ * initializeScheduler:
+ *   Convierte el periodo de microsegundos a ciclos (una sola vez) y
+ *   fija el primer plazo un periodo después del instante actual.
  */
-void limpiarPantalla(volatile unsigned int* ledBase, int width, int height) {
-    for (int i = 0; i < width * height; i++)
-        ledBase[i] = BLACK;
+void initializeScheduler(SchedulerType* sched, unsigned int periodUs) {
+    sched->period   = (unsigned long long)periodUs * CPU_HZ / 1000000ULL;
+    sched->deadline = readCycles() + sched->period;
+    sched->late     = 0;
+    sched->ticks    = 0;
+    sched->overruns = 0;
 }
 
 /**
- * isFreeZone:
- *   - Comprueba si un bloque 2×2 en la posición lineal `pos`
- *     está completamente libre (todos BLACK).
- *   - Útil antes de colocar la manzana para no solaparse con
- *     la serpiente ni con los bordes.
- *   - Devuelve 1 (verdadero) si todos los LEDs están en BLACK.
+ * tickDue:
+ *   Versión no bloqueante del planificador: dice si a la tarea ya le
+ *   toca su siguiente tick. Si es así, guarda en `late` cuánto ha
+ *   arrancado tarde y adelanta el plazo un periodo, de modo que el
+ *   retraso no se acumula. Si se ha perdido un periodo entero se cuenta
+ *   como retraso y se resincroniza (sin intentar recuperar ticks
+ *   perdidos). Con periodo 0 toca siempre.
  */
-int isFreeZone(volatile unsigned int* ledBase, int pos, int width) {
-    return ledBase[pos]            == BLACK &&
-           ledBase[pos + 1]        == BLACK &&
-           ledBase[pos + width]    == BLACK &&
-           ledBase[pos + width + 1]== BLACK;
+int tickDue(SchedulerType* sched, unsigned long long now) {
+    if (now < sched->deadline) return 0;
+
+    sched->late = now - sched->deadline;
+    sched->ticks++;
+    if (sched->period == 0) {
+        sched->deadline = now;
+    }
+    else if (sched->late >= sched->period) {
+        sched->overruns++;
+        sched->deadline = now + sched->period;
+    }
+    else {
+        sched->deadline += sched->period;
+    }
+    return 1;
+}
+
+
+/*─── IMPLEMENTACIONES: PERFILADO ───────────────────────────────────────────*/
+#ifdef SNAKE_PROFILE
+
+/**
+ * readInstret:
+ *   Contador de instrucciones retiradas (rdinstret), leído igual que
+ *   readCycles en RV32. El host no tiene equivalente y devuelve 0.
+ */
+unsigned long long readInstret(void) {
+#if defined(RIPES_HOST)
+    return 0;
+#elif defined(__riscv) && __riscv_xlen == 32
+    unsigned int hi, lo, hi2;
+    do {
+        __asm__ volatile ("rdinstreth %0" : "=r"(hi));
+        __asm__ volatile ("rdinstret  %0" : "=r"(lo));
+        __asm__ volatile ("rdinstreth %0" : "=r"(hi2));
+    } while (hi != hi2);
+    return ((unsigned long long)hi << 32) | lo;
+#else
+    unsigned long long c;
+    __asm__ volatile ("rdinstret %0" : "=r"(c));
+    return c;
+#endif
+}
+
+void profileReset(ProfileType* prof) {
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        PhaseStats* st = &prof->phase[p];
+        st->count      = 0;
+        st->minCycles  = ~0ULL;
+        st->maxCycles  = 0;
+        st->sumCycles  = 0;
+        st->sumInstret = 0;
+        for (int b = 0; b < PROFILE_BUCKETS; b++) st->histogram[b] = 0;
+    }
 }
 
 /**
- * checkBoundary:
- *   - Dado un par de coordenadas (headX, headY),
- *     comprueba si están fuera de los límites [0..width-1]×[0..height-1].
- *   - Devuelve 1 si la cabeza se saldría de la matriz (colisión con borde).
- *   - Se invoca antes de mover la serpiente para detectar GAME OVER.
+ * profileRecord:
+ *   Acumula una medida. El cubo del histograma es el número de bits
+ *   significativos de la duración: el cubo b cuenta [2^(b-1), 2^b).
  */
-int checkBoundary(int headX, int headY, int width, int height) {
-    return headX < 0 || headX >= width ||
-           headY < 0 || headY >= height;
+void profileRecord(ProfileType* prof, PhaseType phase,
+                   unsigned long long cycles, unsigned long long instret) {
+    PhaseStats* st = &prof->phase[phase];
+    int bucket = cycles ? 64 - __builtin_clzll(cycles) : 0;
+    if (bucket >= PROFILE_BUCKETS) bucket = PROFILE_BUCKETS - 1;
+
+    st->count++;
+    st->sumCycles  += cycles;
+    st->sumInstret += instret;
+    if (cycles < st->minCycles) st->minCycles = cycles;
+    if (cycles > st->maxCycles) st->maxCycles = cycles;
+    st->histogram[bucket]++;
 }
 
 /**
- * createNode:
- *   - Reserva dinámicamente un nuevo nodo de la serpiente.
- *   - Reserva un array de 4 punteros (`n->leds`) para un bloque 2×2.
- *   - Inicializa esos 4 punteros señalando a las 4 esquinas
- *     empezando en `blockBase`.
- *   - Fija `next = NULL`. Devuelve el nodo listo para insertarlo
- *     en la lista de la serpiente.
- *
- *   Nota: `blockBase` debe apuntar a la esquina superior izquierda
- *         del bloque 2×2 que representa el segmento de la serpiente.
+ * profileDump:
+ *   Imprime por la consola (stdout en el host) una línea por fase con
+ *   mínimo, media y máximo en ciclos (ns en el host) e instrucciones
+ *   medias, seguida de los cubos no vacíos de su histograma.
+ */
+void profileDump(ProfileType* prof) {
+    static const char* const names[PHASE_COUNT] = {
+        [PHASE_INPUT] = "entrada", [PHASE_BOUNDS] = "borde",
+        [PHASE_PROBE] = "sondeo",  [PHASE_MOVE]   = "movimiento",
+        [PHASE_APPLE] = "manzana", [PHASE_RENDER] = "render",
+        [PHASE_LATENCY] = "latencia",
+    };
+
+    printf("PERFIL: fase n min media max instr\n");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        PhaseStats* st = &prof->phase[p];
+        if (st->count == 0) continue;
+        printf("  %-10s %u %llu %llu %llu %llu\n", names[p], st->count, st->minCycles,
+               st->sumCycles / st->count, st->maxCycles, st->sumInstret / st->count);
+        printf("    log2:");
+        for (int b = 0; b < PROFILE_BUCKETS; b++)
+            if (st->histogram[b]) printf(" [%d]=%u", b, st->histogram[b]);
+        printf("\n");
+    }
+}
+#endif /* SNAKE_PROFILE */
+
+
+/*─── IMPLEMENTACIONES: ENTRADA ─────────────────────────────────────────────*/
+
+/**
+ * initializeInput:
+ *   Guarda los registros del D-Pad indexados por motion y parte de
+ *   "nada pulsado" y cola vacía.
  */
-Node* createNode(volatile unsigned int* blockBase, int width) {
-    Node* n = (Node*)malloc(sizeof(Node));
-    n->leds = (volatile unsigned int**)malloc(4 * sizeof(volatile unsigned int*));
-    n->leds[0] = blockBase;
-    n->leds[1] = blockBase + 1;
-    n->leds[2] = blockBase + width;
-    n->leds[3] = blockBase + width + 1;
-    n->next    = NULL;
+void initializeInput(InputType* input) {
+    input->pads[RIGHT] = D_PAD_0_RIGHT;
+    input->pads[LEFT]  = D_PAD_0_LEFT;
+    input->pads[UP]    = D_PAD_0_UP;
+    input->pads[DOWN]  = D_PAD_0_DOWN;
+    input->prev        = 0;
+    input->mmioReads   = 0;
+    resetInput(input, DOWN);
+}
+
+/**
+ * resetInput:
+ *   Vacía la cola de giros y toma `currentDir` como dirección de
+ *   referencia para la regla de los 180°. No toca `prev`, así que un
+ *   botón que siga pulsado al reiniciar no cuenta como pulsación nueva.
+ */
+void resetInput(InputType* input, motion currentDir) {
+    input->first   = 0;
+    input->count   = 0;
+    input->lastDir = currentDir;
+}
+
+/**
+ * sampleInput:
+ *   - Lee los cuatro registros del D-Pad y detecta flancos de subida
+ *     respecto a la muestra anterior.
+ *   - Cada nueva pulsación encola un giro si no es la misma dirección
+ *     ni la opuesta a la última encolada (regla de los 180° aplicada
+ *     sobre la cola, no sobre la dirección actual), y si cabe.
+ *   - Con varias pulsaciones en la misma muestra se sigue la prioridad
+ *     del juego original: arriba, abajo, izquierda, derecha.
+ */
+void sampleInput(InputType* input) {
+    static const motion order[4]    = { UP, DOWN, LEFT, RIGHT };
+    static const motion opposite[4] = { LEFT, RIGHT, DOWN, UP };   // por motion
+
+    RIPES_HOST_POLL();
+
+    unsigned int now = 0;
+    for (int d = 0; d < 4; d++)
+        now |= (*input->pads[d] == 1) << d;
+    input->mmioReads += 4;
+
+    unsigned int pressed = now & ~input->prev;
+    input->prev = now;
+
+    for (int i = 0; pressed && i < 4; i++) {
+        motion d = order[i];
+        if (!(pressed & (1u << d))) continue;
+        if (d == input->lastDir || d == opposite[input->lastDir]) continue;
+        if (input->count == TURN_QUEUE_LEN) break;
+
+        int slot = input->first + input->count++;
+        if (slot >= TURN_QUEUE_LEN) slot -= TURN_QUEUE_LEN;
+        input->queue[slot] = (unsigned char)d;
+        input->lastDir     = d;
+    }
+}
+
+/**
+ * nextDirection:
+ *   Devuelve el primer giro de la cola y lo consume; si la cola está
+ *   vacía se mantiene `currentDir`. Se llama una vez por tick.
+ */
+motion nextDirection(InputType* input, motion currentDir) {
+    if (input->count == 0) return currentDir;
+
+    motion d = (motion)input->queue[input->first];
+    if (++input->first == TURN_QUEUE_LEN) input->first = 0;
+    input->count--;
+    return d;
+}
+
+
+/*─── IMPLEMENTACIONES: GRABACIÓN ───────────────────────────────────────────*/
+
+// Búfer de serialización compartido por saveRecording y loadRecording:
+// la grabación se lee una vez al arrancar y se decodifica a su estructura,
+// así que nunca se usan a la vez
+static unsigned char recordBuffer[RECORD_BYTES];
+
+/**
+ * startRecording:
+ *   Deja la grabación vacía con la semilla, las dimensiones (en
+ *   bloques), los muros (levelChecksum) y el modo de bordes del tablero
+ *   de la partida que empieza.
+ */
+void startRecording(RecordingType* rec, unsigned int seed, int cols, int rows,
+                    unsigned int level, int wrap) {
+    rec->seed       = seed;
+    rec->level      = level;
+    rec->wrap       = (unsigned short)(wrap != 0);
+    rec->cols       = (unsigned short)cols;
+    rec->rows       = (unsigned short)rows;
+    rec->count      = 0;
+    rec->ticks      = 0;
+    rec->overflow   = 0;
+    rec->rewound    = 0;
+    rec->cursor     = 0;
+    rec->cursorLeft = 0;
+}
+
+/**
+ * recordDirection:
+ *   Alarga el último tramo si la dirección se repite (hasta 14 bits de
+ *   longitud) o abre uno nuevo. Si no quedan tramos libres se marca
+ *   overflow y se deja de grabar.
+ */
+void recordDirection(RecordingType* rec, motion dir) {
+    if (rec->overflow) return;
+    rec->ticks++;
+
+    if (rec->count > 0) {
+        unsigned short last = rec->runs[rec->count - 1];
+        if ((last >> 14) == dir && (last & RECORD_MAX_RUN) < RECORD_MAX_RUN) {
+            rec->runs[rec->count - 1] = last + 1;
+            return;
+        }
+    }
+    if (rec->count == RECORD_MAX_RUNS) {
+        rec->overflow = 1;
+        return;
+    }
+    rec->runs[rec->count++] = (unsigned short)((dir << 14) | 1);
+}
+
+/**
+ * nextReplayDirection:
+ *   Avanza el cursor de reproducción un tick y devuelve su dirección,
+ *   o -1 cuando ya no quedan ticks grabados.
+ */
+int nextReplayDirection(RecordingType* rec) {
+    while (rec->cursorLeft == 0) {
+        if (rec->cursor == rec->count) return -1;
+        rec->cursorLeft = rec->runs[rec->cursor++] & RECORD_MAX_RUN;
+    }
+    rec->cursorLeft--;
+    return rec->runs[rec->cursor - 1] >> 14;
+}
+
+/**
+ * encodeRecording:
+ *   Serializa en little-endian: magic "SNK3", semilla y suma de los
+ *   muros (32 bits), ancho y alto del tablero en bloques, bordes (1 si
+ *   es toroidal) y número de tramos (16 bits) y los tramos (16 bits
+ *   cada uno).
+ *   `out` debe tener al menos RECORD_BYTES. Devuelve los bytes escritos.
+ */
+int encodeRecording(RecordingType* rec, unsigned char* out) {
+    unsigned int header[7] = { RECORD_MAGIC, rec->seed, rec->level, rec->cols, rec->rows,
+                               rec->wrap, (unsigned int)rec->count };
+    int n = 0;
+    for (int i = 0; i < 7; i++) {
+        int bytes = i < 3 ? 4 : 2;
+        for (int b = 0; b < bytes; b++)
+            out[n++] = (unsigned char)(header[i] >> (8 * b));
+    }
+    for (int i = 0; i < rec->count; i++) {
+        out[n++] = (unsigned char)rec->runs[i];
+        out[n++] = (unsigned char)(rec->runs[i] >> 8);
+    }
     return n;
 }
 
 /**
- * delay_ms:
- *   - Genera un simple retardo aproximado de `ms` milisegundos
- *     usando un bucle de operación dummy en la CPU.
- *   - Se usa para controlar la velocidad de movimiento de la serpiente.
+ * decodeRecording:
+ *   Operación inversa de encodeRecording. Comprueba el magic y que el
+ *   tamaño cuadre; deja el cursor de reproducción al principio.
+ *   Devuelve 1 si la grabación es válida.
  */
-void delay_ms(int ms) {
-    int cnt;
-    for (int i = 0; i < ms * LOOPS_PER_MS; i++) {
-        cnt++;
+int decodeRecording(RecordingType* rec, const unsigned char* in, int len) {
+    if (len < RECORD_HEADER) return 0;
+
+    unsigned int header[7];
+    int n = 0;
+    for (int i = 0; i < 7; i++) {
+        int bytes = i < 3 ? 4 : 2;
+        header[i] = 0;
+        for (int b = 0; b < bytes; b++)
+            header[i] |= (unsigned int)in[n++] << (8 * b);
+    }
+    if (header[0] != RECORD_MAGIC || header[5] > 1 || header[6] > RECORD_MAX_RUNS ||
+        len != RECORD_HEADER + 2 * (int)header[6])
+        return 0;
+
+    startRecording(rec, header[1], header[3], header[4], header[2], header[5]);
+    rec->count = header[6];
+    for (int i = 0; i < rec->count; i++, n += 2) {
+        rec->runs[i] = (unsigned short)(in[n] | (in[n + 1] << 8));
+        rec->ticks  += rec->runs[i] & RECORD_MAX_RUN;
     }
+    return 1;
 }
 
 /**
- * freeSnake:
- *   - Recorre todos los nodos de la serpiente desde la cabeza a la cola.
- *   - Para cada nodo, libera primero el array dinámico `leds`,
- *     luego libera el propio nodo.
- *   - Finalmente libera la estructura `SnakeType`.
- *   - Garantiza que no quedan fugas de memoria al salir del juego.
+ * saveRecording:
+ *   Entrega la grabación serializada al host para que la escriba
+ *   (en Ripes se queda en memoria). Una grabación desbordada no se
+ *   guarda porque no reproduciría la partida completa.
  */
-void freeSnake(SnakeType* snake) {
-    Node* cur = snake->head;
-    while (cur) {
-        Node* next = cur->next;
-        free(cur->leds);
-        free(cur);
-        cur = next;
+void saveRecording(RecordingType* rec) {
+    unsigned char* buf = recordBuffer;
+    if (rec->overflow) {
+        printf("grabación desbordada: no se guarda\n");
+        return;
+    }
+    if (rec->rewound) {
+        printf("partida rebobinada: la grabación no se guarda\n");
+        return;
     }
-    free(snake);
+    int len = encodeRecording(rec, buf);
+    RIPES_HOST_SAVE(buf, len);
 }
 
 /**
- * computeNewHeadBase:
- *   - Recibe el puntero al LED [0] del bloque actual de la cabeza,
- *     la dirección de movimiento y el ancho de la matriz.
- *   - Calcula y retorna el puntero a la esquina superior izquierda
- *     del **siguiente** bloque 2×2 en esa dirección.
- *   - Utilizado tanto en movimiento normal como en crecimiento
- *     para posicionar la nueva cabeza.
+ * loadRecording:
+ *   Pide al host una grabación para reproducir. Solo se acepta si es
+ *   válida y se grabó con las mismas dimensiones de tablero, los mismos
+ *   muros (`level`, de levelChecksum) y el mismo modo de bordes: con
+ *   otros la partida sería distinta. Devuelve 1 si hay partida que
+ *   reproducir.
  */
-volatile unsigned int* computeNewHeadBase(volatile unsigned int* oldHeadLed, motion currentDir, int width) {
-    switch (currentDir) {
-      case UP:    return oldHeadLed - 2*width;
-      case DOWN:  return oldHeadLed + 2*width;
-      case LEFT:  return oldHeadLed - 2;
-      case RIGHT: return oldHeadLed + 2;
-      default: return oldHeadLed;
+int loadRecording(RecordingType* rec, int cols, int rows, unsigned int level, int wrap) {
+    unsigned char* buf = recordBuffer;
+    int len = RIPES_HOST_LOAD(buf, RECORD_BYTES);
+    if (len <= 0) return 0;
+
+    if (!decodeRecording(rec, buf, len) || rec->cols != cols || rec->rows != rows ||
+        rec->level != level || rec->wrap != (wrap != 0)) {
+        printf("grabación no válida para un tablero %s de %dx%d bloques con muros %08x\n",
+               wrap ? "toroidal" : "con bordes", cols, rows, level);
+        return 0;
     }
+    return 1;
 }
 
+/**
+ * boardChecksum:
+ *   FNV-1a de 32 bits sobre la rejilla de ocupación. Dos partidas que
+ *   acaban con la misma disposición de serpiente y manzana dan el
+ *   mismo valor.
+ */
+unsigned int boardChecksum(BoardType* board) {
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < board->cols * board->rows; i++) {
+        h ^= board->cells[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
+/*─── IMPLEMENTACIONES: PILOTO AUTOMÁTICO ───────────────────────────────────*/
+
+/**
+ * stepDirection:
+ *   Dirección que lleva del bloque `from` a su vecino `to`.
+ */
+static motion stepDirection(int from, int to) {
+    for (int d = 0; d < 4; d++)
+        if (stepTable[d][from] == to) return (motion)d;
+    return DOWN;
+}
+
+/**
+ * cycleDistance:
+ *   Número de pasos de `from` a `to` siguiendo el ciclo hamiltoniano.
+ */
+static int cycleDistance(AutopilotType* ai, int from, int to) {
+    int d = ai->cycleOrder[to] - ai->cycleOrder[from];
+    return d < 0 ? d + ai->cells : d;
+}
+
+/**
+ * initializeAutopilot:
+ *   Ciclo hamiltoniano del tablero (solo existe si un lado es par y
+ *   ambos >= 2): recorre en zigzag las filas dejando libre la columna 0
+ *   y vuelve hacia arriba por ella. Si el alto es impar se hace lo
+ *   mismo por columnas. Se guarda la posición de cada bloque en el
+ *   ciclo y la dirección hacia su sucesor. Los vecinos salen de la
+ *   tabla de pasos del tablero. El ciclo no sabe de muros, así que con
+ *   un nivel cargado no se usa.
+ */
+void initializeAutopilot(AutopilotType* ai, BoardType* board) {
+    int cols = board->cols, rows = board->rows;
+
+    ai->cells = cols * rows;
+    ai->stamp = 0;
+    ai->overBudget = 0;
+    for (int b = 0; b < ai->cells; b++)
+        ai->seen[b] = ai->blocked[b] = 0;
+
+    ai->hasCycle = cols >= 2 && rows >= 2 && (cols % 2 == 0 || rows % 2 == 0) &&
+                   !board->level;
+    if (!ai->hasCycle) return;
+
+    // Recorrido sobre "filas" de longitud a (número par b de ellas);
+    // con swap las filas del recorrido son las columnas del tablero
+    int swap = rows % 2 != 0;
+    int a    = swap ? rows : cols;
+    int bn   = swap ? cols : rows;
+    unsigned short* seq = ai->queue;          // búfer temporal
+    int k = 0;
+    for (int j = 0; j < bn; j++)
+        for (int t = 1; t < a; t++) {
+            int i = (j % 2 == 0) ? t : a - t;
+            seq[k++] = (unsigned short)(swap ? i * cols + j : j * cols + i);
+        }
+    for (int j = bn - 1; j >= 0; j--)
+        seq[k++] = (unsigned short)(swap ? j : j * cols);
+
+    for (k = 0; k < ai->cells; k++) {
+        int next = seq[k + 1 == ai->cells ? 0 : k + 1];
+        ai->cycleOrder[seq[k]] = (unsigned short)k;
+        ai->cycleDir[seq[k]]   = (unsigned char)stepDirection(seq[k], next);
+    }
+}
+
+/**
+ * searchBlocked:
+ *   Indica si la búsqueda no puede pisar el bloque, según la ocupación
+ *   real o la simulada con blockedStamp (ver autopilotSearch).
+ */
+static int searchBlocked(AutopilotType* ai, BoardType* board, int block, unsigned int blockedStamp) {
+    if (!blockedStamp)                             return isObstacle(board, block);
+    if (ai->blocked[block] == blockedStamp)        return 1;
+    if (ai->blocked[block] == blockedStamp - 1)    return 0;
+    return isObstacle(board, block);
+}
+
+/**
+ * autopilotSearch:
+ *   Búsqueda en anchura de `from` a `target` sobre la tabla de vecinos.
+ *   Con blockedStamp == 0 no se pueden pisar serpientes ni muros; si no,
+ *   la ocupación es simulada: se bloquean además los marcados con ese
+ *   valor en ai->blocked, y los marcados con blockedStamp - 1 se dan
+ *   por libres aunque la rejilla diga otra cosa (cuerpo que ya se ha
+ *   apartado). `target` siempre se puede pisar.
+ *   Deja el camino (sin `from`, terminado en `target`) en ai->path y
+ *   devuelve su longitud, 0 si no hay camino o -1 si se agota el
+ *   presupuesto del tick.
+ */
+int autopilotSearch(AutopilotType* ai, BoardType* board, int from, int target,
+                    unsigned int blockedStamp) {
+    unsigned int stamp = ++ai->stamp;
+    int first = 0, last = 0;
+
+    ai->queue[last++] = (unsigned short)from;
+    ai->seen[from]    = stamp;
+    ai->parent[from]  = -1;
+
+    while (first < last) {
+        if (ai->deadline && (first & 7) == 7 && readCycles() > ai->deadline) {
+            ai->overBudget++;
+            return -1;
+        }
+        int cur = ai->queue[first++];
+        for (int d = 0; d < 4; d++) {
+            int n = stepTable[d][cur];
+            if (n == NO_BLOCK || ai->seen[n] == stamp) continue;
+            if (n != target && searchBlocked(ai, board, n, blockedStamp)) continue;
+
+            ai->seen[n]   = stamp;
+            ai->parent[n] = (short)cur;
+            if (n == target) {
+                int len = 0;
+                for (int c = n; c != from; c = ai->parent[c]) len++;
+                int i = len;
+                for (int c = n; c != from; c = ai->parent[c]) ai->path[--i] = (unsigned short)c;
+                return len;
+            }
+            ai->queue[last++] = (unsigned short)n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * tailReachableAfter:
+ *   Simula que la serpiente recorre el camino de ai->path (longitud
+ *   `len`) y se come la manzana del final, y comprueba que desde ahí
+ *   la nueva cabeza sigue pudiendo llegar a la nueva cola. Los muros y
+ *   las demás serpientes siguen siendo obstáculos.
+ */
+static int tailReachableAfter(AutopilotType* ai, BoardType* board, SnakeType* snake, int len) {
+    unsigned short* path = ai->path;
+    int apple = path[len - 1];
+
+    // Cuerpo tras comer: los últimos length+1 bloques de cuerpo+camino
+    // (el primero es la nueva cola y el último la manzana); los de antes
+    // quedan libres
+    unsigned int freed = ++ai->stamp;
+    unsigned int mark  = ++ai->stamp;
+    int total = snake->length + len;
+    int newTail = -1;
+    int block = snake->tail;
+    for (int i = 0; i < total; i++) {
+        if (i >= snake->length)  block = path[i - snake->length];
+        else if (i > 0)          block = stepTable[segmentDir(snake, i - 1)][block];
+        if (i < len - 1)      ai->blocked[block] = freed;
+        else if (newTail < 0) newTail = block;
+        else                  ai->blocked[block] = mark;
+    }
+    return autopilotSearch(ai, board, apple, newTail, mark) > 0;
+}
+
+/**
+ * autopilotDirection:
+ *   Decide la dirección del tick dentro del presupuesto AUTOPILOT_BUDGET.
+ *   - Con ciclo hamiltoniano: por defecto sigue el ciclo, que recorre
+ *     todo el tablero y nunca deja la cola inalcanzable. Mientras la
+ *     serpiente ocupa menos de AUTOPILOT_SHORTCUT_PCT del tablero toma
+ *     el primer paso del camino más corto a la manzana si ese atajo no
+ *     se salta la manzana y deja por delante, hasta la cola en el orden
+ *     del ciclo, al menos AUTOPILOT_CYCLE_MARGIN bloques además del
+ *     siguiente (la cola avanza uno si el paso no come). Así el bloque
+ *     siguiente del ciclo nunca es la cola, aunque se coma por el camino.
+ *   - Sin ciclo (o si el ciclo no es seguido, p. ej. al activar SW1 a
+ *     mitad de partida): camino más corto a la manzana si tras comerla
+ *     la cola sigue alcanzable, si no perseguir la cola y, en último
+ *     caso, cualquier vecino libre.
+ *   Si una búsqueda agota el presupuesto se pasa a la opción más barata.
+ */
+motion autopilotDirection(AutopilotType* ai, BoardType* board, SnakeType* snake,
+                          AppleType* apple, motion currentDir) {
+    int head = snake->head;
+    int tail = snake->tail;
+    int len;
+
+    ai->deadline = AUTOPILOT_BUDGET ? readCycles() + AUTOPILOT_BUDGET : 0;
+
+    if (ai->hasCycle) {
+        int next = stepTable[ai->cycleDir[head]][head];
+        if (apple->block >= 0 && snake->length * 100 < ai->cells * AUTOPILOT_SHORTCUT_PCT &&
+            (len = autopilotSearch(ai, board, head, apple->block, 0)) > 0 && ai->path[0] != next) {
+            int room = snake->length == 1 ? ai->cells : cycleDistance(ai, head, tail);
+            int jump = cycleDistance(ai, head, ai->path[0]);
+            // Distancia a la cola tras el paso: si no come, la cola avanza
+            int left = room - jump + (ai->path[0] != apple->block);
+            if (left >= 2 + AUTOPILOT_CYCLE_MARGIN && jump <= cycleDistance(ai, head, apple->block))
+                return stepDirection(head, ai->path[0]);
+        }
+        if (!isObstacle(board, next))
+            return (motion)ai->cycleDir[head];
+    }
+
+    // 1) Camino a la manzana comprobando que después la cola es alcanzable
+    if (apple->block >= 0 && (len = autopilotSearch(ai, board, head, apple->block, 0)) > 0) {
+        int step = ai->path[0];
+        if (tailReachableAfter(ai, board, snake, len))
+            return stepDirection(head, step);
+    }
+
+    // 2) Perseguir la cola (sin entrar directamente en ella)
+    if (snake->length > 1 && (len = autopilotSearch(ai, board, head, tail, 0)) > 1)
+        return stepDirection(head, ai->path[0]);
+
+    // 3) Cualquier vecino libre, manteniendo la dirección si se puede
+    int n = stepTable[currentDir][head];
+    if (n != NO_BLOCK && !isObstacle(board, n)) return currentDir;
+    for (int d = 0; d < 4; d++) {
+        n = stepTable[d][head];
+        if (n != NO_BLOCK && !isObstacle(board, n)) return (motion)d;
+    }
+    return currentDir;
+}
+
+
+/*─── IMPLEMENTACIONES: HUD ─────────────────────────────────────────────────*/
+
+// Glifos 3×5 de los dígitos: una fila por byte, bit 2 = columna izquierda
+static const unsigned char glyphRows[GLYPH_BLANK + 1][GLYPH_HEIGHT] = {
+    { 7, 5, 5, 5, 7 }, { 2, 6, 2, 2, 7 }, { 7, 1, 7, 4, 7 }, { 7, 1, 7, 1, 7 },
+    { 5, 5, 7, 1, 1 }, { 7, 4, 7, 1, 7 }, { 7, 4, 7, 5, 7 }, { 7, 1, 1, 1, 1 },
+    { 7, 5, 7, 5, 7 }, { 7, 5, 7, 1, 7 }, { 0, 0, 0, 0, 0 },
+};
+
+/**
+ * initializeHud:
+ *   Sitúa los dígitos en las GLYPH_HEIGHT últimas filas de la matriz,
+ *   con una columna de margen, y los da por vacíos: la franja tiene que
+ *   estar apagada (limpiarPantalla al arrancar).
+ */
+void initializeHud(HudType* hud, volatile unsigned int* ledBase, int width) {
+    hud->base  = ledBase + (LED_MATRIX_0_HEIGHT - GLYPH_HEIGHT) * width + 1;
+    hud->width = width;
+    hud->value = 0;
+    hud->mmioWrites = 0;
+    for (int d = 0; d < HUD_DIGITS; d++) hud->glyph[d] = GLYPH_BLANK;
+}
+
+/**
+ * updateHud:
+ *   Si el valor ha cambiado, calcula el glifo de cada dígito (sin ceros
+ *   a la izquierda; se satura a 9...9) y, de los dígitos que cambian,
+ *   copia a la matriz solo las filas cuyo patrón es distinto, cada una
+ *   como una ráfaga de GLYPH_WIDTH escrituras consecutivas. Sumar uno
+ *   suele tocar un dígito y pocas filas. Devuelve las escrituras MMIO.
+ */
+unsigned int updateHud(HudType* hud, unsigned int value) {
+    unsigned char glyph[HUD_DIGITS];
+    unsigned int writes = 0;
+
+    if (value == hud->value) return 0;
+    hud->value = value;
+
+    // 1) Dígitos de derecha a izquierda
+    unsigned int max = 1;
+    for (int d = 0; d < HUD_DIGITS; d++) max *= 10;
+    if (value >= max) value = max - 1;
+    for (int d = HUD_DIGITS - 1; d >= 0; d--) {
+        glyph[d] = (unsigned char)(value % 10);
+        value /= 10;
+        if (value == 0) {
+            while (--d >= 0) glyph[d] = GLYPH_BLANK;
+        }
+    }
+
+    // 2) Copiar las filas que cambian de los dígitos que cambian
+    for (int d = 0; d < HUD_DIGITS; d++) {
+        if (glyph[d] == hud->glyph[d]) continue;
+        const unsigned char* from = glyphRows[hud->glyph[d]];
+        const unsigned char* to   = glyphRows[glyph[d]];
+        volatile unsigned int* led = hud->base + d * (GLYPH_WIDTH + 1);
+        for (int r = 0; r < GLYPH_HEIGHT; r++, led += hud->width) {
+            if (from[r] == to[r]) continue;
+            for (int c = 0; c < GLYPH_WIDTH; c++)
+                led[c] = (to[r] >> (GLYPH_WIDTH - 1 - c)) & 1 ? HUD_COLOR : BLACK;
+            writes += GLYPH_WIDTH;
+        }
+        hud->glyph[d] = glyph[d];
+    }
+    hud->mmioWrites = writes;
+    return writes;
+}
+
+
+/*─── IMPLEMENTACIONES: UTILIDADES ──────────────────────────────────────────*/
+
+/**
+ * initializeRandom:
+ *   - Siembra el estado del generador xorshift32 una vez por partida.
+ *   - Un estado 0 dejaría el generador bloqueado en 0, así que se
+ *     sustituye por una constante.
+ */
+void initializeRandom(unsigned int* rng, unsigned int seed) {
+    *rng = seed ? seed : 0x9E3779B9u;
+}
+
+/**
+ * nextRandom:
+ *   - Avanza el generador xorshift32 (Marsaglia) y devuelve el nuevo
+ *     estado. Solo usa desplazamientos y XOR, sin srand/rand.
+ */
+unsigned int nextRandom(unsigned int* rng) {
+    unsigned int x = *rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *rng = x;
+}
+
+/**
+ * limpiarPantalla:
+ *   - Recorre toda la matriz LED de tamaño width×height.
+ *   - Asigna el color BLACK (apagado) a cada celda.
+ *   - Se invoca al inicio del juego para empezar con pantalla limpia.
+ */
+void limpiarPantalla(volatile unsigned int* ledBase, int width, int height) {
+    for (int i = 0; i < width * height; i++)
+        ledBase[i] = BLACK;
+}